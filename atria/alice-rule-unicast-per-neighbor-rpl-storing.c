@@ -48,12 +48,14 @@
 */
 #include "contiki.h"
 #include "orchestra.h"
+#include "atria-planner.h"
 #include "net/ipv6/uip-ds6-route.h"
 #include "net/packetbuf.h"
 #include "net/rpl/rpl-conf.h"
 #include "net/mac/tsch/tsch-private.h"
 //#include "net/mac/tsch/tsch-asn.h"
 #include <stdbool.h>
+#include <string.h>
 
 #if ORCHESTRA_UNICAST_SENDER_BASED && ORCHESTRA_COLLISION_FREE_HASH
 #define UNICAST_SLOT_SHARED_FLAG    ((ORCHESTRA_UNICAST_PERIOD < (ORCHESTRA_MAX_HASH + 1)) ? LINK_OPTION_SHARED : 0)
@@ -73,8 +75,6 @@
 uint16_t asfn_schedule=0; //absolute slotframe number for ATRIA time varying scheduling
 uint16_t pre_asfn=0;
 uint16_t routing_change=0; //
-static uint16_t sub_period = 3;
-static uint16_t num_sub_period = 67;
 
 static uint16_t slotframe_handle = 0;
 static struct tsch_slotframe *sf_unicast;
@@ -83,6 +83,82 @@ uint8_t link_option_rx = LINK_OPTION_RX ;
 //uint8_t link_option_tx = LINK_OPTION_TX | UNICAST_SLOT_SHARED_FLAG ; //ksh.. If it is a shared link, backoff will be applied.
 uint8_t link_option_tx = LINK_OPTION_TX ; 
 
+/* Compute the cells of the next slotframe in process context, ahead of the
+ * slotframe boundary, so that the slotframe start callback only has to swap
+ * plans instead of hashing every cell from the TSCH interrupt */
+#ifdef ATRIA_CONF_PLAN_AHEAD
+#define ATRIA_PLAN_AHEAD ATRIA_CONF_PLAN_AHEAD
+#else
+#define ATRIA_PLAN_AHEAD 1
+#endif
+
+/* The cells of the unicast slotframe for one ASFN, in sf_unicast->links_list
+ * order and structure-of-arrays layout for atria_plan_cells(). The first
+ * num_planned cells are computed, the rest only copy the timing of the last
+ * child cells. direction 0 means only the timing is to be updated. order
+ * holds the capacity links by timeslot, for tsch_schedule_links_sorted(). */
+struct atria_plan {
+  uint16_t asfn;
+  uint16_t generation;
+  uint16_t num_cells;
+  uint16_t num_planned;
+  uint16_t capacity;
+  volatile uint8_t ready;
+  uint16_t link_hash[TSCH_SCHEDULE_MAX_LINKS];
+  uint16_t cell_seq[TSCH_SCHEDULE_MAX_LINKS];
+  uint16_t schedule_num[TSCH_SCHEDULE_MAX_LINKS];
+  uint16_t timeslot[TSCH_SCHEDULE_MAX_LINKS];
+  uint16_t channel_offset[TSCH_SCHEDULE_MAX_LINKS];
+  uint8_t link_options[TSCH_SCHEDULE_MAX_LINKS];
+  uint8_t direction[TSCH_SCHEDULE_MAX_LINKS];
+  uint16_t order[TSCH_SCHEDULE_MAX_LINKS];
+};
+
+/* current_plan is owned by the slotframe start callback. next_plan is filled
+ * by atria_plan_process and handed over by setting its ready flag. */
+static struct atria_plan plans[ATRIA_PLAN_AHEAD ? 2 : 1];
+static struct atria_plan *current_plan = &plans[0];
+#if ATRIA_PLAN_AHEAD
+static struct atria_plan *next_plan = &plans[1];
+/* Incremented on every routing change, invalidates plans computed before */
+static volatile uint16_t plan_generation;
+/* Set by the slotframe start callback when it left the plan of the current
+ * slotframe, deferred_asfn, to atria_plan_process, as the slot operation is
+ * overloaded. Until the plan is applied the unicast links are suspended,
+ * neither Tx nor Rx, and asfn_schedule stays on the previous ASFN. */
+static volatile uint8_t plan_deferred;
+static volatile uint16_t deferred_asfn;
+
+PROCESS(atria_plan_process, "ATRIA plan process");
+#endif
+
+/* Neighbors with unicast cells, by link-layer address. Rebuilt on every
+ * reschedule so that packet selection does not walk nbr_routes. */
+#ifdef ATRIA_CONF_NBR_INDEX_SIZE
+#define ATRIA_NBR_INDEX_SIZE ATRIA_CONF_NBR_INDEX_SIZE
+#else
+#define ATRIA_NBR_INDEX_SIZE 128
+#endif
+
+#if (ATRIA_NBR_INDEX_SIZE & (ATRIA_NBR_INDEX_SIZE - 1)) != 0 \
+    || ATRIA_NBR_INDEX_SIZE <= NBR_TABLE_MAX_NEIGHBORS + 1
+#error "ATRIA_NBR_INDEX_SIZE must be a power of two larger than NBR_TABLE_MAX_NEIGHBORS + 1"
+#endif
+
+/* Roles, numbered like the direction of the links */
+#define ATRIA_NBR_NONE   0
+#define ATRIA_NBR_CHILD  1
+#define ATRIA_NBR_PARENT 2
+
+struct atria_nbr {
+  linkaddr_t addr;
+  uint8_t role;
+};
+static struct atria_nbr nbr_index[ATRIA_NBR_INDEX_SIZE];
+/* Set while the index misses a routing change, as the rebuild could not
+ * take the TSCH lock: the next packet or slotframe start retries it */
+static uint8_t nbr_index_dirty;
+
 
 /*-------------------------------------------------------------------------------*/
 static uint16_t
@@ -177,48 +253,6 @@ get_node_multiple_channel_offset_ds(const linkaddr_t *addr1, const linkaddr_t *a
 }
 /*---------------------------------------------------------------------------*/
 
-/*------------------------------- Xia ---------------------------------------*/
-static uint16_t
-get_slotframe_offset(const linkaddr_t *addr1, const linkaddr_t *addr2, uint16_t block_seq, uint16_t block_size)
-{
-
-  if(addr1 != NULL && addr2 != NULL && block_size > 0) {
-
-    return real_hash((ORCHESTRA_LINKADDR_HASH2(addr1, addr2)+asfn_schedule*(block_seq+1)), (block_size)); 
-  } 
-  else {
-    return 0xffff;
-  }
-}
-
-static uint16_t
-get_slot_offset(const linkaddr_t *addr1, const linkaddr_t *addr2, uint16_t block_seq)
-{
-
-  if(addr1 != NULL && addr2 != NULL && sub_period > 0) {
-
-    return real_hash((ORCHESTRA_LINKADDR_HASH2(addr1, addr2)+asfn_schedule*(block_seq+1)), (sub_period)); 
-  } 
-  else {
-    return 0xffff;
-  }
-}
-
-static uint16_t
-get_channel_offset(const linkaddr_t *addr1, const linkaddr_t *addr2, uint16_t block_seq)
-{
-
-  int num_ch = (sizeof(TSCH_DEFAULT_HOPPING_SEQUENCE)/sizeof(uint8_t))-1; 
-  if(addr1 != NULL && addr2 != NULL  && num_ch > 0) {
-
-    return 1+real_hash((ORCHESTRA_LINKADDR_HASH2(addr1, addr2)+asfn_schedule*(block_seq+1)), num_ch); 
-  } 
-  else {
-    return 1+0; 
-  }
-}
-/*---------------------------------------------------------------------------*/
-
 uint16_t
 is_root(){
   rpl_instance_t *instance =rpl_get_default_instance();
@@ -251,29 +285,131 @@ int neighbor_routes_count(linkaddr_t *addr)
   return count;
 }
 /*---------------------------------------------------------------------------*/
+static uint16_t
+atria_nbr_hash(const linkaddr_t *addr)
+{
+  return real_hash_mix((addr->u8[LINKADDR_SIZE - 2] << 8) | addr->u8[LINKADDR_SIZE - 1])
+         & (ATRIA_NBR_INDEX_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the role of a neighbor, ATRIA_NBR_NONE if it has no unicast cells */
+static uint8_t
+atria_nbr_role(const linkaddr_t *addr)
+{
+  uint16_t i = atria_nbr_hash(addr);
 
+  while(nbr_index[i].role != ATRIA_NBR_NONE) {
+    if(linkaddr_cmp(&nbr_index[i].addr, addr)) {
+      return nbr_index[i].role;
+    }
+    i = (i + 1) & (ATRIA_NBR_INDEX_SIZE - 1);
+  }
+  return ATRIA_NBR_NONE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+atria_nbr_add(const linkaddr_t *addr, uint8_t role)
+{
+  uint16_t i = atria_nbr_hash(addr);
 
+  while(nbr_index[i].role != ATRIA_NBR_NONE) {
+    if(linkaddr_cmp(&nbr_index[i].addr, addr)) {
+      return; /* The parent role takes precedence, it is added first */
+    }
+    i = (i + 1) & (ATRIA_NBR_INDEX_SIZE - 1);
+  }
+  linkaddr_copy(&nbr_index[i].addr, addr);
+  nbr_index[i].role = role;
+}
 /*---------------------------------------------------------------------------*/
+/* Fills the index from the current parent and nbr_routes */
 static void
-atria_RESCHEDULE_unicast_slotframe1(void){   //remove current slotframe scheduling and re-schedule this slotframe.
+atria_nbr_index_rebuild(void)
+{
+  nbr_table_item_t *item;
 
-//  printf("Self address: %u slotframe: %d\n", linkaddr_node_addr.u8[LINKADDR_SIZE-1], asfn_schedule);
-  uint16_t timeslot_us, timeslot_ds, channel_offset_us, channel_offset_ds;
-  uint16_t timeslot_us_p, timeslot_ds_p, channel_offset_us_p, channel_offset_ds_p; //parent's schedule
-  uint8_t link_option_up, link_option_down;
-  uint16_t slotframe_offset, slot_offset, cell_seq, block_size;
+  nbr_index_dirty = 1;
+  if(tsch_get_lock()) {
+    memset(nbr_index, 0, sizeof(nbr_index));
+    if(!linkaddr_cmp(&orchestra_parent_linkaddr, &linkaddr_null)) {
+      atria_nbr_add(&orchestra_parent_linkaddr, ATRIA_NBR_PARENT);
+    }
+    for(item = nbr_table_head(nbr_routes); item != NULL; item = nbr_table_next(nbr_routes, item)) {
+      atria_nbr_add(nbr_table_get_lladdr(nbr_routes, item), ATRIA_NBR_CHILD);
+    }
+    nbr_index_dirty = 0;
+    tsch_release_lock();
+  }
+}
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Appends cell cell_seq of schedule_num of the link tx -> rx */
+static void
+atria_plan_add_cell(struct atria_plan *plan, uint8_t link_options, const linkaddr_t *tx, const linkaddr_t *rx,
+                    uint16_t cell_seq, uint16_t schedule_num, uint8_t direction)
+{
+  uint16_t k;
+
+  if(plan->num_cells < plan->capacity) {
+    k = plan->num_cells++;
+    plan->link_options[k] = link_options;
+    plan->link_hash[k] = ORCHESTRA_LINKADDR_HASH2(tx, rx);
+    plan->cell_seq[k] = cell_seq;
+    plan->schedule_num[k] = schedule_num;
+    plan->direction[k] = direction;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Orders the links by the timeslot the plan gives them, ties in list order,
+ * so that applying the plan does not sort the link index. Links past the
+ * plan's cells keep their timeslot. Insertion sort: a node has few links,
+ * and it needs no room */
+static void
+atria_plan_sort(struct atria_plan *plan)
+{
+  struct tsch_link *l = list_head(sf_unicast->links_list);
+  uint16_t k, j, timeslot;
+
+  for(k = 0; k < plan->capacity; k++) {
+    if(k >= plan->num_cells) {
+      plan->timeslot[k] = l != NULL ? l->timeslot : 0;
+    }
+    if(l != NULL) {
+      l = list_item_next(l);
+    }
+    timeslot = plan->timeslot[k];
+    for(j = k; j > 0 && plan->timeslot[plan->order[j - 1]] > timeslot; j--) {
+      plan->order[j] = plan->order[j - 1];
+    }
+    plan->order[j] = k;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Computes the cells of the unicast slotframe for a given ASFN, one per link of
+ * sf_unicast in list order. Only reads the schedule, the links are updated by
+ * atria_apply_plan() at the slotframe boundary. */
+static void
+atria_plan_unicast_slotframe(struct atria_plan *plan, uint16_t asfn){
+
+//  printf("Self address: %u slotframe: %d\n", linkaddr_node_addr.u8[LINKADDR_SIZE-1], asfn);
+  uint8_t link_option_up = 0, link_option_down = 0;
   int     schedule_num, i;
-  float   block_avg;
+  int     last_us = -1, last_ds = -1; //last child cells, copied by the padding cells
+  uint8_t pad = 0;
+  uint16_t k;
 
-  struct tsch_link *l;
-  l = list_head(sf_unicast->links_list);
+  plan->asfn = asfn;
+  plan->num_cells = 0;
+  plan->capacity = list_length(sf_unicast->links_list);
 
  if(is_root()!=1){
 //schedule the links between parent-node and current node
-  if(l!=NULL){
-    if(pre_asfn != asfn_schedule && pre_asfn%6 == 0)
+  if(plan->num_cells < plan->capacity){
+    if(pre_asfn != asfn && pre_asfn%6 == 0)
     {
-      printf("R : %d, a:%d, addr:%u\n", uip_ds6_route_num_routes(), asfn_schedule, orchestra_parent_linkaddr.u8[LINKADDR_SIZE-1]);
+      printf("R : %d, a:%d, addr:%u\n", uip_ds6_route_num_routes(), asfn, orchestra_parent_linkaddr.u8[LINKADDR_SIZE-1]);
     }
     schedule_num = uip_ds6_route_num_routes() + 1;  
     #if IMP_METHOD3
@@ -282,49 +418,17 @@ atria_RESCHEDULE_unicast_slotframe1(void){   //remove current slotframe scheduli
         schedule_num = schedule_num * 2;
      
 
-        block_avg = (float)num_sub_period/(float)schedule_num;
-      //  printf("B_S is %f\n", block_avg);
         for(i=1; i<=schedule_num; i++)
         {
-          if(i < schedule_num) {
-            block_size = (uint16_t)(block_avg*i) - (uint16_t)(block_avg*(i-1));
-          }
-          else {
-            block_size = num_sub_period - (uint16_t)(block_avg*(i-1));
-          }
           if(i%2 == 1) {
-            slotframe_offset = get_slotframe_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, i, block_size);
-            slot_offset = get_slot_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, i);
-            timeslot_us_p = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-            channel_offset_us_p = get_channel_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, i);
             link_option_up=link_option_tx;
 
-            if(l!=NULL) {
-              l->link_options=link_option_up;
-              l->timeslot=timeslot_us_p;
-              l->channel_offset=channel_offset_us_p;
-              l->cell_seq = i;
-              l->schedule_num = schedule_num;
-              l->direction = 2;
-              l = list_item_next(l);
-            } 
+            atria_plan_add_cell(plan, link_option_up, &linkaddr_node_addr, &orchestra_parent_linkaddr, i, schedule_num, 2);
           }
           else {
-            slotframe_offset = get_slotframe_offset(&orchestra_parent_linkaddr, &linkaddr_node_addr, i, block_size);
-            slot_offset = get_slot_offset(&orchestra_parent_linkaddr, &linkaddr_node_addr, i);
-            timeslot_ds_p = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-            channel_offset_ds_p = get_channel_offset(&orchestra_parent_linkaddr, &linkaddr_node_addr, i);
             link_option_down=link_option_rx;
 
-            if(l!=NULL) {
-              l->link_options=link_option_down;
-              l->timeslot=timeslot_ds_p;
-              l->channel_offset=channel_offset_ds_p;
-              l->cell_seq = i;
-              l->schedule_num = schedule_num;
-              l->direction = 2;
-              l = list_item_next(l);
-            }
+            atria_plan_add_cell(plan, link_option_down, &orchestra_parent_linkaddr, &linkaddr_node_addr, i, schedule_num, 2);
           }
         }
       }
@@ -334,7 +438,7 @@ atria_RESCHEDULE_unicast_slotframe1(void){   //remove current slotframe scheduli
  }//is_root()! end
 
   nbr_table_item_t *item = nbr_table_head(nbr_routes);
-  while(l!=NULL && item!=NULL) {    
+  while(plan->num_cells < plan->capacity && item!=NULL) {    
 
     linkaddr_t *addr = nbr_table_get_lladdr(nbr_routes, item);
 
@@ -343,81 +447,33 @@ atria_RESCHEDULE_unicast_slotframe1(void){   //remove current slotframe scheduli
        printf("PARENT MATCH\n");
        if(item==NULL){
          printf("NULL ITEM\n");
-
-#ifdef ALICE_TSCH_CALLBACK_SLOTFRAME_START // sf update
-           while(l!=NULL){
-              
-              //parent downlink schedule
-              l->link_options=link_option_up;
-              l->timeslot=timeslot_us;
-              l->channel_offset=channel_offset_us;
-              l = list_item_next(l);     
-              
-              if(l!=NULL){
-                 //parent downlink schedule
-                 l->link_options=link_option_down;
-                 l->timeslot=timeslot_ds;
-                 l->channel_offset=channel_offset_ds;
-                 l = list_item_next(l);
-              }
-           }
-#endif
-           return;
+         pad = 1;
+         break;
        }
     }
 
-    if(pre_asfn != asfn_schedule && pre_asfn%6 == 0)
+    if(pre_asfn != asfn && pre_asfn%6 == 0)
     {
-      printf("N :%d a:%d, addr:%u \n", neighbor_routes_count(addr), asfn_schedule, addr->u8[LINKADDR_SIZE-1]);
+      printf("N :%d a:%d, addr:%u \n", neighbor_routes_count(addr), asfn, addr->u8[LINKADDR_SIZE-1]);
     } 
   #if IMP_METHOD3
     schedule_num = neighbor_routes_count(addr) * 2;
     
 
     if(schedule_num > 0) { 
-      block_avg = (float)num_sub_period/(float)schedule_num;
-    //  printf("B_S is %f\n", block_avg);
       for(i=1; i<=schedule_num; i++)
       {
-        if(i < schedule_num) {
-          block_size = (uint16_t)(block_avg*i) - (uint16_t)(block_avg*(i-1));
-        }
-        else {
-          block_size = num_sub_period - (uint16_t)(block_avg*(i-1));
-        }
         if(i%2 == 1) {
-          slotframe_offset = get_slotframe_offset(addr, &linkaddr_node_addr, i, block_size);
-          slot_offset = get_slot_offset(addr, &linkaddr_node_addr, i);
-          timeslot_us = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-          channel_offset_us = get_channel_offset(addr, &linkaddr_node_addr, i);
           link_option_up=link_option_rx;
+          last_us = plan->num_cells;
    
-          if(l!=NULL) {
-            l->link_options=link_option_up;
-            l->timeslot=timeslot_us;
-            l->channel_offset=channel_offset_us;
-            l->cell_seq = i;
-            l->schedule_num = schedule_num;
-            l->direction = 1;
-            l = list_item_next(l);
-          } 
+          atria_plan_add_cell(plan, link_option_up, addr, &linkaddr_node_addr, i, schedule_num, 1);
         }
         else {
-          slotframe_offset = get_slotframe_offset(&linkaddr_node_addr, addr, i, block_size);
-          slot_offset = get_slot_offset(&linkaddr_node_addr, addr, i);
-          timeslot_ds = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-          channel_offset_ds = get_channel_offset(&linkaddr_node_addr, addr, i);
           link_option_down=link_option_tx;
+          last_ds = plan->num_cells;
  
-          if(l!=NULL) {
-            l->link_options=link_option_down;
-            l->timeslot=timeslot_ds;
-            l->channel_offset=channel_offset_ds;
-            l->cell_seq = i;
-            l->schedule_num = schedule_num;
-            l->direction = 1;
-            l = list_item_next(l);
-          }
+          atria_plan_add_cell(plan, link_option_down, &linkaddr_node_addr, addr, i, schedule_num, 1);
         }
       }
     }
@@ -426,7 +482,146 @@ atria_RESCHEDULE_unicast_slotframe1(void){   //remove current slotframe scheduli
     item = nbr_table_next(nbr_routes, item);    
   } //while end..
 
+  /* All the hashing, in one pass */
+  plan->num_planned = plan->num_cells;
+  atria_plan_cells(asfn, plan->num_planned, plan->link_hash, plan->cell_seq, plan->schedule_num,
+                   plan->timeslot, plan->channel_offset);
+
+#ifdef ALICE_TSCH_CALLBACK_SLOTFRAME_START // sf update
+  if(pad) {
+    /* The parent was the last route neighbor: the remaining links get the
+     * timing of the last child cells, alternately upstream and downstream */
+    while(plan->num_cells < plan->capacity) {
+      k = plan->num_cells++;
+      i = ((k - plan->num_planned) % 2 == 0) ? last_us : last_ds;
+      plan->link_options[k] = (k - plan->num_planned) % 2 == 0 ? link_option_up : link_option_down;
+      plan->timeslot[k] = i >= 0 ? plan->timeslot[i] : 0;
+      plan->channel_offset[k] = i >= 0 ? plan->channel_offset[i] : 0;
+      plan->direction[k] = 0;
+    }
+  }
+#endif
+  atria_plan_sort(plan);
 }
+/*---------------------------------------------------------------------------*/
+/* Writes a plan into the links of sf_unicast. Called at the slotframe boundary. */
+static void
+atria_apply_plan(const struct atria_plan *plan)
+{
+  struct tsch_link *l = list_head(sf_unicast->links_list);
+  uint16_t k;
+
+  /* Invalidate the next links looked up ahead before rewriting any */
+  tsch_schedule_links_updated(sf_unicast);
+  for(k = 0; l != NULL && k < plan->num_cells; k++) {
+    l->link_options = plan->link_options[k];
+    l->timeslot = plan->timeslot[k];
+    l->channel_offset = plan->channel_offset[k];
+    if(plan->direction[k] != 0) {
+      l->cell_seq = plan->cell_seq[k];
+      l->schedule_num = plan->schedule_num[k];
+      l->direction = plan->direction[k];
+    }
+    l = list_item_next(l);
+  }
+  /* Links the plan has no cell for this slotframe stay out of use */
+  for(; l != NULL; l = list_item_next(l)) {
+    l->link_options &= ~(LINK_OPTION_TX | LINK_OPTION_RX);
+  }
+  tsch_schedule_links_sorted(sf_unicast, plan->order, plan->capacity);
+}
+/*---------------------------------------------------------------------------*/
+#if ATRIA_PLAN_AHEAD
+/* Takes the links of sf_unicast out of use until the next atria_apply_plan():
+ * their cells are those of another slotframe, where peers no longer listen */
+static void
+atria_suspend_links(void)
+{
+  struct tsch_link *l;
+
+  tsch_schedule_links_updated(sf_unicast);
+  for(l = list_head(sf_unicast->links_list); l != NULL; l = list_item_next(l)) {
+    l->link_options &= ~(LINK_OPTION_TX | LINK_OPTION_RX);
+  }
+  /* No timeslot changed */
+  tsch_schedule_links_sorted(sf_unicast, NULL, 0);
+}
+#endif
+/*---------------------------------------------------------------------------*/
+/* Returns the ASFN following a given one, wrapping like the TSCH slotframe counter */
+static uint16_t
+atria_next_asfn(uint16_t asfn)
+{
+  return asfn == (uint16_t)(65535 / ORCHESTRA_UNICAST_PERIOD) ? 0 : asfn + 1;
+}
+/*---------------------------------------------------------------------------*/
+#if ATRIA_PLAN_AHEAD
+/* Fills next_plan for the slotframe after the current one, unless it already holds it */
+static void
+atria_prepare_next_plan(void)
+{
+  struct atria_plan *plan = next_plan;
+  uint16_t generation = plan_generation;
+  uint16_t asfn = atria_next_asfn(plan_deferred ? deferred_asfn : asfn_schedule);
+
+  if(sf_unicast == NULL
+     || (plan->ready && plan->asfn == asfn && plan->generation == generation)) {
+    return;
+  }
+
+  plan->ready = 0;
+  atria_plan_unicast_slotframe(plan, asfn);
+  plan->generation = generation;
+  /* Hand the plan over only if it was not swapped out in the meantime */
+  if(plan == next_plan) {
+    plan->ready = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Plans the current slotframe, whose start callback deferred it, and applies
+ * the plan under the TSCH lock unless the slotframe is over meanwhile */
+static void
+atria_apply_deferred_plan(void)
+{
+  struct atria_plan *plan = next_plan;
+  uint16_t asfn = deferred_asfn;
+
+  plan->ready = 0;
+  atria_plan_unicast_slotframe(plan, asfn);
+  plan->generation = plan_generation;
+  if(tsch_get_lock()) {
+    if(plan_deferred && deferred_asfn == asfn && plan == next_plan) {
+      next_plan = current_plan;
+      current_plan = plan;
+      asfn_schedule = asfn;
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+      tsch_queue_invalidate_packet_selection();
+#endif
+      atria_apply_plan(current_plan);
+      plan_deferred = 0;
+    }
+    tsch_release_lock();
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(atria_plan_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(nbr_index_dirty) {
+      atria_nbr_index_rebuild();
+    }
+    if(plan_deferred) {
+      atria_apply_deferred_plan();
+    }
+    atria_prepare_next_plan();
+  }
+
+  PROCESS_END();
+}
+#endif /* ATRIA_PLAN_AHEAD */
 
 /*---------------------------------------------------------------------------*/
 static void
@@ -436,12 +631,22 @@ atria_schedule_unicast_slotframe(const linkaddr_t *change_addr, uint16_t reason)
   uint16_t timeslot_us, timeslot_ds, channel_offset_us, channel_offset_ds;
   uint16_t timeslot_us_p, timeslot_ds_p, channel_offset_us_p, channel_offset_ds_p; //parent's schedule
   uint8_t link_option_up, link_option_down;
-  uint16_t cell_seq, slotframe_offset, slot_offset;
-  uint16_t neighbor_seq, block_size;
-  int     schedule_num;
-  float   block_avg;
+#if IMP_METHOD1 || IMP_METHOD2
+  uint16_t cell_seq;
+#endif
+  uint16_t neighbor_seq;
+  int     schedule_num = 0;
   int     i;
 
+#if ATRIA_PLAN_AHEAD
+  /* Any plan computed so far no longer matches the links */
+  plan_generation++;
+#endif
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+  tsch_queue_invalidate_packet_selection();
+#endif
+  atria_nbr_index_rebuild();
+
 //remove the whole links scheduled in the unicast slotframe
   struct tsch_link *l;
   l = list_head(sf_unicast->links_list);
@@ -476,8 +681,8 @@ atria_schedule_unicast_slotframe(const linkaddr_t *change_addr, uint16_t reason)
       link_option_up=link_option_tx;
       link_option_down=link_option_rx;
       printf("Up tx:%d %d, rx:%d %d\n", timeslot_us_p, channel_offset_us_p, timeslot_ds_p, channel_offset_ds_p);
-      tsch_schedule_add_multiple_link(sf_unicast, link_option_up, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_us_p, channel_offset_us_p, cell_seq);
-      tsch_schedule_add_multiple_link(sf_unicast, link_option_down, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_ds_p, channel_offset_ds_p, cell_seq);
+      tsch_schedule_add_multiple_link(sf_unicast, link_option_up, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_us_p, channel_offset_us_p, cell_seq, 2);
+      tsch_schedule_add_multiple_link(sf_unicast, link_option_down, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_ds_p, channel_offset_ds_p, cell_seq, 2);
     }
   #endif
   #if IMP_METHOD2
@@ -525,32 +730,18 @@ atria_schedule_unicast_slotframe(const linkaddr_t *change_addr, uint16_t reason)
 
       if(schedule_num > 0)
       {     
-        block_avg = (float)num_sub_period/(float)schedule_num;
-      //  printf("Average block_size is %f\n", block_avg);
         for(i=1; i<=schedule_num; i++)
         {
-          if(i<schedule_num) {
-            block_size = (uint16_t)(block_avg*i) - (uint16_t)(block_avg*(i-1));
-          }
-          else {
-            block_size = num_sub_period - (uint16_t)(block_avg*(i-1));
-          }
           if(i%2 == 1)
           {
-            slotframe_offset = get_slotframe_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, i, block_size);
-            slot_offset = get_slot_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, i);
-            timeslot_us_p = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-            channel_offset_us_p = get_channel_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, i);
+            atria_plan_cell(&linkaddr_node_addr, &orchestra_parent_linkaddr, asfn_schedule, i, schedule_num, &timeslot_us_p, &channel_offset_us_p);
             link_option_up=link_option_tx;
 
             tsch_schedule_add_evenly_link(sf_unicast, link_option_up, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_us_p, channel_offset_us_p, i, schedule_num, 2);
           }
           else
           {
-            slotframe_offset = get_slotframe_offset(&orchestra_parent_linkaddr, &linkaddr_node_addr, i, block_size);
-            slot_offset = get_slot_offset(&orchestra_parent_linkaddr, &linkaddr_node_addr, i);
-            timeslot_ds_p = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-            channel_offset_ds_p = get_channel_offset(&orchestra_parent_linkaddr, &linkaddr_node_addr, i);
+            atria_plan_cell(&orchestra_parent_linkaddr, &linkaddr_node_addr, asfn_schedule, i, schedule_num, &timeslot_ds_p, &channel_offset_ds_p);
             link_option_down=link_option_rx;
 
             tsch_schedule_add_evenly_link(sf_unicast, link_option_down, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_ds_p, channel_offset_ds_p, i, schedule_num, 2); 
@@ -614,30 +805,17 @@ atria_schedule_unicast_slotframe(const linkaddr_t *change_addr, uint16_t reason)
     
 
     if(schedule_num > 0) { 
-      block_avg = (float)num_sub_period/(float)schedule_num;
     
       for(i=1; i<=schedule_num; i++)
       {
-        if(i < schedule_num) {
-          block_size = (uint16_t)(block_avg*i) - (uint16_t)(block_avg*(i-1));
-        }
-        else {
-          block_size = num_sub_period - (uint16_t)(block_avg*(i-1));
-        }
         if(i%2 == 1) {
-          slotframe_offset = get_slotframe_offset(addr, &linkaddr_node_addr, i, block_size);
-          slot_offset = get_slot_offset(addr, &linkaddr_node_addr, i);
-          timeslot_us = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-          channel_offset_us = get_channel_offset(addr, &linkaddr_node_addr, i);
+          atria_plan_cell(addr, &linkaddr_node_addr, asfn_schedule, i, schedule_num, &timeslot_us, &channel_offset_us);
           link_option_up = link_option_rx; 
       
           tsch_schedule_add_evenly_link(sf_unicast, link_option_up, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_us, channel_offset_us, i, schedule_num, 1);
         }
         else {
-          slotframe_offset = get_slotframe_offset(&linkaddr_node_addr, addr, i, block_size);
-          slot_offset = get_slot_offset(&linkaddr_node_addr, addr, i);
-          timeslot_ds = (slotframe_offset + (uint16_t)(block_avg * (i - 1))) * sub_period + slot_offset; 
-          channel_offset_ds = get_channel_offset(&linkaddr_node_addr, addr, i);
+          atria_plan_cell(&linkaddr_node_addr, addr, asfn_schedule, i, schedule_num, &timeslot_ds, &channel_offset_ds);
           link_option_down = link_option_tx;
         
           tsch_schedule_add_evenly_link(sf_unicast, link_option_down, LINK_TYPE_NORMAL, &tsch_broadcast_address, timeslot_ds, channel_offset_ds, i, schedule_num, 1);
@@ -650,15 +828,58 @@ atria_schedule_unicast_slotframe(const linkaddr_t *change_addr, uint16_t reason)
     item = nbr_table_next(nbr_routes, item);
   }
   routing_change = 0;
+#if ATRIA_PLAN_AHEAD
+  if(plan_deferred && tsch_get_lock()) {
+    /* The links were laid out for asfn_schedule, not the current slotframe.
+     * Checked again as the slotframe start may have applied a plan since */
+    if(plan_deferred) {
+      atria_suspend_links();
+    }
+    tsch_release_lock();
+  }
+  process_poll(&atria_plan_process);
+#endif
 //  tsch_schedule_print();
 }
 
 /*---------------------------------------------------------------------------*/ // slotframe_callback. 
 #ifdef ALICE_TSCH_CALLBACK_SLOTFRAME_START
 void alice_callback_slotframe_start (uint16_t sfid, uint16_t sfsize){  
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+  tsch_queue_invalidate_packet_selection();
+#endif
+#if ATRIA_PLAN_AHEAD
+  struct atria_plan *plan = next_plan;
+  if(plan->ready && plan->asfn == sfid && plan->generation == plan_generation) {
+    /* The plan process got there first: swap buffers */
+    next_plan = current_plan;
+    current_plan = plan;
+    next_plan->ready = 0;
+    plan_deferred = 0;
+  } else if(tsch_slot_overloaded) {
+    /* Missing or stale plan, and no time to spare: suspend the unicast
+     * cells until the plan process has computed the plan, rather than
+     * keep those of the previous slotframe, which peers no longer use */
+    plan->ready = 0;
+    plan_deferred = 1;
+    deferred_asfn = sfid;
+    atria_suspend_links();
+  } else {
+    /* Missing or stale plan: fall back to computing it here */
+    plan->ready = 0;
+    plan_deferred = 0;
+    atria_plan_unicast_slotframe(current_plan, sfid);
+  }
+  if(!plan_deferred) {
+    asfn_schedule=sfid; // update curr asfn_schedule.
+    atria_apply_plan(current_plan);
+  }
+  process_poll(&atria_plan_process);
+#else
   asfn_schedule=sfid; // update curr asfn_schedule.
-//  printf("CALL(%d)\n", asfn_schedule);
-  atria_RESCHEDULE_unicast_slotframe1();
+  atria_plan_unicast_slotframe(current_plan, sfid);
+  atria_apply_plan(current_plan);
+#endif
   pre_asfn = asfn_schedule;
 
 }
@@ -668,25 +889,22 @@ void alice_callback_slotframe_start (uint16_t sfid, uint16_t sfsize){
 int alice_callback_packet_selection (uint16_t* ts, uint16_t* choff, const linkaddr_t rx_lladdr){
 
 
+  uint8_t role = atria_nbr_role(&rx_lladdr);
+
 //schedule the links between parent-node and current node
-  if(linkaddr_cmp(&orchestra_parent_linkaddr, &rx_lladdr)){
+  if(role == ATRIA_NBR_PARENT){
     *ts= get_node_timeslot_us(&linkaddr_node_addr, &orchestra_parent_linkaddr);
     *choff= get_node_channel_offset_us(&linkaddr_node_addr, &orchestra_parent_linkaddr);       
 //    printf("ksh.. PCS.... parent : (%u,%u)\n", *ts, *choff);
     return 1;
   }
 
-//schedule the links between child-node and current node   //(lookup all route next hops)
-  nbr_table_item_t *item = nbr_table_head(nbr_routes);
-  while(item != NULL) {
-    linkaddr_t *addr = nbr_table_get_lladdr(nbr_routes, item);
-    if(linkaddr_cmp(addr, &rx_lladdr)){
-      *ts= get_node_timeslot_ds(&linkaddr_node_addr, addr);
-      *choff= get_node_channel_offset_ds(&linkaddr_node_addr, addr); 
+//schedule the links between child-node and current node
+  if(role == ATRIA_NBR_CHILD){
+    *ts= get_node_timeslot_ds(&linkaddr_node_addr, &rx_lladdr);
+    *choff= get_node_channel_offset_ds(&linkaddr_node_addr, &rx_lladdr); 
 
-      return 1;
-    } 
-    item = nbr_table_next(nbr_routes, item);
+    return 1;
   }
 
  
@@ -702,25 +920,22 @@ int alice_callback_packet_selection (uint16_t* ts, uint16_t* choff, const linkad
 #ifdef IMP_CALLBACK_PACKET_SELECTION
 int imp_callback_packet_selection (uint16_t* ts, uint16_t* choff, const linkaddr_t rx_lladdr, uint16_t cell_seq)
 {
+  uint8_t role = atria_nbr_role(&rx_lladdr);
+
 //schedule the links between parent-node and current node
-  if(linkaddr_cmp(&orchestra_parent_linkaddr, &rx_lladdr)){
+  if(role == ATRIA_NBR_PARENT){
     *ts= get_node_multiple_timeslot_us(&linkaddr_node_addr, &orchestra_parent_linkaddr, cell_seq);
     *choff= get_node_multiple_channel_offset_us(&linkaddr_node_addr, &orchestra_parent_linkaddr, cell_seq);       
 
     return 1;
   }
 
-//schedule the links between child-node and current node   //(lookup all route next hops)
-  nbr_table_item_t *item = nbr_table_head(nbr_routes);
-  while(item != NULL) {
-    linkaddr_t *addr = nbr_table_get_lladdr(nbr_routes, item);
-    if(linkaddr_cmp(addr, &rx_lladdr)){
-      *ts= get_node_multiple_timeslot_ds(&linkaddr_node_addr, addr, cell_seq);
-      *choff= get_node_multiple_channel_offset_ds(&linkaddr_node_addr, addr, cell_seq); 
+//schedule the links between child-node and current node
+  if(role == ATRIA_NBR_CHILD){
+    *ts= get_node_multiple_timeslot_ds(&linkaddr_node_addr, &rx_lladdr, cell_seq);
+    *choff= get_node_multiple_channel_offset_ds(&linkaddr_node_addr, &rx_lladdr, cell_seq); 
 
-      return 1;
-    } 
-    item = nbr_table_next(nbr_routes, item);
+    return 1;
   }
 
  
@@ -737,50 +952,21 @@ int imp_callback_packet_selection (uint16_t* ts, uint16_t* choff, const linkaddr
 #ifdef SPE_CALLBACK_PACKET_SELECTION
 int spe_callback_packet_selection (uint16_t* ts, uint16_t* choff, const linkaddr_t rx_lladdr, uint16_t cell_seq, uint16_t schedule_num)
 {
-  float block_avg;
-  uint16_t block_size;
-  uint16_t slotframe_offset, slot_offset;
+  uint8_t role = atria_nbr_role(&rx_lladdr);
 
 //schedule the links between parent-node and current node
-  if(linkaddr_cmp(&orchestra_parent_linkaddr, &rx_lladdr)) {
-    block_avg = (float)num_sub_period/(float)schedule_num;
-    if(cell_seq<schedule_num) {
-      block_size = (uint16_t)(block_avg*cell_seq) - (uint16_t)(block_avg*(cell_seq-1));
-    }
-    else {
-      block_size = num_sub_period - (uint16_t)(block_avg*(cell_seq-1));
-    }
+  if(role == ATRIA_NBR_PARENT) {
     if(cell_seq%2 == 1) {
-      slotframe_offset = get_slotframe_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, cell_seq, block_size);
-      slot_offset = get_slot_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, cell_seq);
-      *ts = (slotframe_offset + (uint16_t)(block_avg * (cell_seq - 1))) * sub_period + slot_offset; 
-      *choff = get_channel_offset(&linkaddr_node_addr, &orchestra_parent_linkaddr, cell_seq);
+      atria_plan_cell(&linkaddr_node_addr, &orchestra_parent_linkaddr, asfn_schedule, cell_seq, schedule_num, ts, choff);
     }
 
     return 1;
   }
 
-//schedule the links between child-node and current node   //(lookup all route next hops)
-  nbr_table_item_t *item = nbr_table_head(nbr_routes);
-  while(item != NULL) {
-    linkaddr_t *addr = nbr_table_get_lladdr(nbr_routes, item);
-    if(linkaddr_cmp(addr, &rx_lladdr)){
-      block_avg = (float)num_sub_period/(float)schedule_num;
-      if(cell_seq < schedule_num) {
-        block_size = (uint16_t)(block_avg*cell_seq) - (uint16_t)(block_avg*(cell_seq-1));
-      }
-      else {
-        block_size = num_sub_period - (uint16_t)(block_avg*(cell_seq-1));
-      }
-      if(cell_seq%2 == 0) {
-        slotframe_offset = get_slotframe_offset(&linkaddr_node_addr, addr, cell_seq, block_size);
-        slot_offset = get_slot_offset(&linkaddr_node_addr, addr, cell_seq);
-        *ts = (slotframe_offset + (uint16_t)(block_avg * (cell_seq - 1))) * sub_period + slot_offset; 
-        *choff = get_channel_offset(&linkaddr_node_addr, addr, cell_seq);
-        return 1;
-      }
-    } 
-    item = nbr_table_next(nbr_routes, item);
+//schedule the links between child-node and current node
+  if(role == ATRIA_NBR_CHILD && cell_seq%2 == 0) {
+    atria_plan_cell(&linkaddr_node_addr, &rx_lladdr, asfn_schedule, cell_seq, schedule_num, ts, choff);
+    return 1;
   }
  
   *ts =0;
@@ -794,11 +980,12 @@ static int
 neighbor_has_uc_link(const linkaddr_t *linkaddr)
 {
   if(linkaddr != NULL && !linkaddr_cmp(linkaddr, &linkaddr_null)) {
+    uint8_t role = atria_nbr_role(linkaddr);
     if(orchestra_parent_knows_us 
-       && linkaddr_cmp(&orchestra_parent_linkaddr, linkaddr)) {
+       && role == ATRIA_NBR_PARENT) {
       return 1;
     }
-    if(nbr_table_get_from_lladdr(nbr_routes, (linkaddr_t *)linkaddr) != NULL  && !linkaddr_cmp(&orchestra_parent_linkaddr, linkaddr)) {
+    if(role == ATRIA_NBR_CHILD) {
       return 1;
     }
   }
@@ -833,14 +1020,18 @@ select_packet(uint16_t *slotframe, uint16_t *timeslot, uint16_t *channel_offset)
 {
   const linkaddr_t *dest = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
 
+  if(nbr_index_dirty) {
+    atria_nbr_index_rebuild();
+  }
   if(packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE) == FRAME802154_DATAFRAME && neighbor_has_uc_link(dest)) {
     if(slotframe != NULL) {
       *slotframe = slotframe_handle;
     }
+    uint8_t role = atria_nbr_role(dest);
     if(timeslot != NULL) {
 
         //if the destination is the parent node, schedule it in the upstream period, if the destination is the child node, schedule it in the downstream period.
-        if(linkaddr_cmp(&orchestra_parent_linkaddr, dest)){
+        if(role == ATRIA_NBR_PARENT){
            *timeslot = get_node_timeslot_us(&linkaddr_node_addr, dest); //parent node (upstream)
         }else{
            *timeslot = get_node_timeslot_ds(&linkaddr_node_addr, dest);  //child node (downstream)
@@ -848,7 +1039,7 @@ select_packet(uint16_t *slotframe, uint16_t *timeslot, uint16_t *channel_offset)
     }
     if(channel_offset != NULL) { 
         //if the destination is the parent node, schedule it in the upstream period, if the destination is the child node, schedule it in the downstream period.
-        if(linkaddr_cmp(&orchestra_parent_linkaddr, dest)){
+        if(role == ATRIA_NBR_PARENT){
            *channel_offset = get_node_channel_offset_us(&linkaddr_node_addr, dest); //child node (upstream)
         }else{
            *channel_offset = get_node_channel_offset_ds(&linkaddr_node_addr, dest); //child node (downstream)
@@ -888,10 +1079,18 @@ init(uint16_t sf_handle)
 
 #ifdef ALICE_TSCH_CALLBACK_SLOTFRAME_START
   asfn_schedule = alice_tsch_schedule_get_current_asfn(sf_unicast);
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+  tsch_queue_invalidate_packet_selection();
+#endif
+  tsch_schedule_set_start_callback(sf_unicast, ALICE_TSCH_CALLBACK_SLOTFRAME_START);
 #else
   asfn_schedule = 0; //sfid (ASN) will not be used.
 #endif
 
+#if ATRIA_PLAN_AHEAD
+  process_start(&atria_plan_process, NULL);
+#endif
+
 }
 /*---------------------------------------------------------------------------*/
 struct orchestra_rule unicast_per_neighbor_rpl_storing = {
@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+/**
+ * \file
+ *         ATRIA cell planner, shared by schedule installation and packet
+ *         selection so that both always place a cell at the same timeslot.
+ */
+
+#include "contiki.h"
+#include "atria-planner.h"
+#include "net/mac/tsch/tsch.h"
+
+#if ATRIA_NUM_SUB_PERIOD > 255
+#error "ATRIA_NUM_SUB_PERIOD does not fit the block boundary table"
+#endif
+
+/* Block boundaries for one schedule_num: block i (1..schedule_num) covers
+ * sub-periods start[i-1] to start[i]-1, start[i] = i*NUM_SUB_PERIOD/schedule_num */
+struct atria_blocks {
+  uint16_t schedule_num;
+  uint8_t start[ATRIA_PLANNER_MAX_BLOCKS + 1];
+};
+
+static ATRIA_PLANNER_CACHE_STORAGE struct atria_blocks blocks_cache[ATRIA_PLANNER_CACHE_SIZE];
+static ATRIA_PLANNER_CACHE_STORAGE uint8_t blocks_cache_next;
+/* Set while a call uses the cache. A call nested in it, from the slot
+ * operation interrupting the plan process, computes its blocks instead:
+ * a refill would rewrite an entry the outer call may be reading. */
+static ATRIA_PLANNER_CACHE_STORAGE volatile uint8_t blocks_cache_busy;
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+block_start(uint16_t block_seq, uint16_t schedule_num)
+{
+  return (uint16_t)(((uint32_t)ATRIA_NUM_SUB_PERIOD * block_seq) / schedule_num);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the cached boundaries for schedule_num, NULL if too many blocks */
+static const struct atria_blocks *
+get_blocks(uint16_t schedule_num)
+{
+  struct atria_blocks *b;
+  uint16_t i;
+
+  if(schedule_num > ATRIA_PLANNER_MAX_BLOCKS) {
+    return NULL;
+  }
+
+  for(i = 0; i < ATRIA_PLANNER_CACHE_SIZE; i++) {
+    if(blocks_cache[i].schedule_num == schedule_num) {
+      return &blocks_cache[i];
+    }
+  }
+
+  b = &blocks_cache[blocks_cache_next];
+  blocks_cache_next = (blocks_cache_next + 1) % ATRIA_PLANNER_CACHE_SIZE;
+  for(i = 0; i <= schedule_num; i++) {
+    b->start[i] = block_start(i, schedule_num);
+  }
+  b->schedule_num = schedule_num;
+  return b;
+}
+/*---------------------------------------------------------------------------*/
+void
+atria_plan_cells(uint16_t asfn, uint16_t num, const uint16_t *link_hash,
+                 const uint16_t *cell_seq, const uint16_t *schedule_num,
+                 uint16_t *timeslot, uint16_t *channel_offset)
+{
+  const struct atria_blocks *b;
+  uint16_t k, end, n, start, size, hash;
+  int num_ch = (sizeof(TSCH_DEFAULT_HOPPING_SEQUENCE)/sizeof(uint8_t))-1;
+  int use_cache = !blocks_cache_busy;
+
+  if(use_cache) {
+    blocks_cache_busy = 1;
+  }
+  for(k = 0; k < num; k = end) {
+    /* Cells come in runs of one schedule_num: look its blocks up once per run */
+    n = schedule_num[k];
+    for(end = k + 1; end < num && schedule_num[end] == n; end++);
+    b = use_cache ? get_blocks(n) : NULL;
+
+    for(; k < end; k++) {
+      if(b != NULL) {
+        start = b->start[cell_seq[k] - 1];
+        size = b->start[cell_seq[k]] - start;
+      } else {
+        start = block_start(cell_seq[k] - 1, n);
+        size = block_start(cell_seq[k], n) - start;
+      }
+
+      /* One mix per cell, reduced for the block, the sub-period and the channel */
+      hash = real_hash_mix(link_hash[k] + asfn * (cell_seq[k] + 1));
+
+      /* With more cells than sub-periods some blocks are empty. Such cells keep
+       * the 0xffff slotframe offset the schedule has always used for them. */
+      timeslot[k] = ((size > 0 ? real_hash_mod(hash, size) : 0xffff) + start) * ATRIA_SUB_PERIOD
+                    + real_hash_mod(hash, ATRIA_SUB_PERIOD);
+      channel_offset[k] = 1 + (num_ch > 0 ? real_hash_mod(hash, num_ch) : 0);
+    }
+  }
+  if(use_cache) {
+    blocks_cache_busy = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+atria_plan_cell(const linkaddr_t *tx, const linkaddr_t *rx, uint16_t asfn,
+                uint16_t cell_seq, uint16_t schedule_num,
+                uint16_t *timeslot, uint16_t *channel_offset)
+{
+  uint16_t link_hash;
+
+  if(tx == NULL || rx == NULL || cell_seq == 0 || cell_seq > schedule_num) {
+    return 0;
+  }
+
+  link_hash = ORCHESTRA_LINKADDR_HASH2(tx, rx);
+  atria_plan_cells(asfn, 1, &link_hash, &cell_seq, &schedule_num, timeslot, channel_offset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
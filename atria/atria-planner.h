@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+/**
+ * \file
+ *         ATRIA cell planner: places cell cell_seq (1..schedule_num) of a link
+ *         in the unicast slotframe of a given ASFN. The slotframe is split in
+ *         ATRIA_NUM_SUB_PERIOD sub-periods of ATRIA_SUB_PERIOD timeslots, the
+ *         sub-periods are partitioned in schedule_num blocks and each cell is
+ *         hashed into its own block. Integer arithmetic only.
+ */
+
+#ifndef __ATRIA_PLANNER_H__
+#define __ATRIA_PLANNER_H__
+
+#include "contiki.h"
+#include "orchestra.h"
+
+/* Timeslots per sub-period */
+#ifdef ATRIA_CONF_SUB_PERIOD
+#define ATRIA_SUB_PERIOD ATRIA_CONF_SUB_PERIOD
+#else
+#define ATRIA_SUB_PERIOD 3
+#endif
+
+#define ATRIA_NUM_SUB_PERIOD (ORCHESTRA_UNICAST_PERIOD / ATRIA_SUB_PERIOD)
+
+/* Number of schedule_num values whose block boundaries are cached */
+#ifdef ATRIA_PLANNER_CONF_CACHE_SIZE
+#define ATRIA_PLANNER_CACHE_SIZE ATRIA_PLANNER_CONF_CACHE_SIZE
+#else
+#define ATRIA_PLANNER_CACHE_SIZE 4
+#endif
+
+/* Storage class of the block cache. Host tools calling the planner from
+ * several threads make it thread-local. */
+#ifdef ATRIA_PLANNER_CONF_CACHE_STORAGE
+#define ATRIA_PLANNER_CACHE_STORAGE ATRIA_PLANNER_CONF_CACHE_STORAGE
+#else
+#define ATRIA_PLANNER_CACHE_STORAGE
+#endif
+
+/* Largest schedule_num with cached block boundaries, larger ones are computed */
+#ifdef ATRIA_PLANNER_CONF_MAX_BLOCKS
+#define ATRIA_PLANNER_MAX_BLOCKS ATRIA_PLANNER_CONF_MAX_BLOCKS
+#else
+#define ATRIA_PLANNER_MAX_BLOCKS TSCH_SCHEDULE_MAX_LINKS
+#endif
+
+/* Timeslots and channel offsets of num cells, in structure-of-arrays layout:
+ * cell k is cell_seq[k] (1..schedule_num[k]) of the link whose
+ * ORCHESTRA_LINKADDR_HASH2(tx, rx) is link_hash[k]. Cells sharing a
+ * schedule_num should be consecutive, the blocks are looked up once per run. */
+void atria_plan_cells(uint16_t asfn, uint16_t num, const uint16_t *link_hash,
+                      const uint16_t *cell_seq, const uint16_t *schedule_num,
+                      uint16_t *timeslot, uint16_t *channel_offset);
+
+/* Timeslot and channel offset of the cell cell_seq of the link tx -> rx,
+ * one of schedule_num cells. Returns 1 if success, 0 if failure */
+int atria_plan_cell(const linkaddr_t *tx, const linkaddr_t *rx, uint16_t asfn,
+                    uint16_t cell_seq, uint16_t schedule_num,
+                    uint16_t *timeslot, uint16_t *channel_offset);
+
+#endif /* __ATRIA_PLANNER_H__ */
@@ -187,6 +187,23 @@
 #define IMP_METHOD4  0
 #undef QUEUEBUF_CONF_NUM
 #define QUEUEBUF_CONF_NUM 32
+/* Per-neighbor priority classes: control, latency-critical data, bulk. Default: 1, stock queue */
+//#define TSCH_QUEUE_CONF_NUM_CLASSES 3
+//#define TSCH_QUEUE_CONF_NUM_PER_CLASS 16
+//#define TSCH_QUEUE_CONF_POLICY TSCH_QUEUE_POLICY_WEIGHTED // default: TSCH_QUEUE_POLICY_STRICT
+/* Packets that cannot use the current cell do not block the ones behind */
+#ifndef TSCH_QUEUE_CONF_LOOKAHEAD
+#define TSCH_QUEUE_CONF_LOOKAHEAD 4
+#endif
+/* Packets towards a neighbor without ATRIA cells (yet) go over the shared slotframe */
+#ifndef TSCH_QUEUE_CONF_UNSCHEDULABLE
+#define TSCH_QUEUE_CONF_UNSCHEDULABLE TSCH_QUEUE_UNSCHEDULABLE_SHARED
+#endif
+/* Neighbors share the QUEUEBUF_CONF_NUM packets: a burst towards one child may
+ * take slots back from neighbors holding more */
+#define TSCH_QUEUE_CONF_EVICTION TSCH_QUEUE_EVICT_LONGEST
+//#define TSCH_QUEUE_CONF_NBR_MIN_PACKETS 2
+//#define TSCH_QUEUE_CONF_NBR_MAX_PACKETS 16
 
 
 /**********************************************************************/
@@ -206,6 +223,8 @@
 // TSCH backoff window setting modification........................//
 //#define TSCH_CONF_MAC_MIN_BE 1//original: 1
 #define TSCH_CONF_MAC_MAX_BE 3 //original: 7
+/* Slot phase timing histograms (tsch_slot_timing), printed by the server */
+//#define TSCH_CONF_SLOT_TIMING 1
 
 // RPL modification..............................................//
 #define RPL_MRHOF_CONF_SQUARED_ETX 0 // mrhof using squared etx.// original value:0
@@ -218,6 +237,12 @@
 
 
 #define TSCH_SCHEDULE_CONF_MAX_LINKS MAX_NODE_NUM*2 // as escalator..
+#define TSCH_SCHEDULE_CONF_LOOKAHEAD 8 // next active links searched ahead, out of the slot ISR
+#define TSCH_CONF_WITH_MAC_STATS 1 // Unicast Tx outcomes per neighbor, reported by the clients
+//#define TSCH_SCHEDULE_CONF_WITH_CELL_STATS 1 // Tx/Rx outcomes per unicast cell position, printed by the server
+#define TSCH_SCHEDULE_CONF_CELL_STATS_SF ALICE_UNICAST_SF_ID
+#define TSCH_SCHEDULE_CONF_CELL_STATS_GROUP 3 // ATRIA_SUB_PERIOD: one position per sub-period
+#define TSCH_SCHEDULE_CONF_CELL_STATS_POSITIONS (ORCHESTRA_CONF_UNICAST_PERIOD / 3)
 
 
 #define RPL_CONF_DIS_INTERVAL 10 // original: 60s
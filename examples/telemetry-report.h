@@ -0,0 +1,89 @@
+/*
+ * Binary report sent by udp-client to udp-server every SEND_INTERVAL.
+ *
+ * Fixed-width little-endian fields at fixed offsets, read and written
+ * byte by byte so that neither side depends on struct packing or alignment.
+ * Counters are deltas since the previous report of the node, modulo 2^16:
+ * the server sees lost reports as gaps in seq.
+ */
+
+#ifndef __TELEMETRY_REPORT_H__
+#define __TELEMETRY_REPORT_H__
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch.h"
+
+#define TELEMETRY_REPORT_VERSION 1
+
+/* flags: the power section follows the base report */
+#define TELEMETRY_REPORT_FLAG_POWER 0x01
+
+/* Base report */
+#define TELEMETRY_REPORT_VERSION_OFFSET   0  /* uint8 */
+#define TELEMETRY_REPORT_FLAGS_OFFSET     1  /* uint8 */
+#define TELEMETRY_REPORT_SEQ_OFFSET       2  /* uint32 */
+#define TELEMETRY_REPORT_ASN_OFFSET       6  /* 5 bytes: ls4b, then ms1b, at send time */
+#define TELEMETRY_REPORT_PARENT_OFFSET    11 /* 2 bytes: last two bytes of the parent address */
+#define TELEMETRY_REPORT_DELAY_OFFSET     13 /* uint16: last server to client delay in slots,
+                                              * 0xffff if none since the previous report */
+#define TELEMETRY_REPORT_ETX_OFFSET       15 /* uint16: parent link ETX */
+#define TELEMETRY_REPORT_REPLIES_OFFSET   17 /* uint16 delta: server replies */
+#define TELEMETRY_REPORT_MAC_OFFSET       19 /* uint16 deltas: struct tsch_mac_stats,
+                                              * tx[dir][status] in index order */
+#define TELEMETRY_REPORT_MAC_COUNTERS     (TSCH_MAC_STATS_NUM_DIRS * TSCH_MAC_STATS_NUM_STATUS)
+#define TELEMETRY_REPORT_DROPS_OFFSET     (TELEMETRY_REPORT_MAC_OFFSET + 2 * TELEMETRY_REPORT_MAC_COUNTERS)
+                                             /* uint16 deltas: tsch_queue_overflow,
+                                              * num_pktdrop_queue, num_pktdrop_mac */
+#define TELEMETRY_REPORT_BASE_LEN         (TELEMETRY_REPORT_DROPS_OFFSET + 6)
+
+/* Power section, with WITH_COMPOWER */
+#define TELEMETRY_REPORT_POWER_OFFSET     TELEMETRY_REPORT_BASE_LEN
+                                             /* uint16: dc_radio, dc_tx, dc_listen, then
+                                              * uint16 deltas: num_pktdrop_rpl, RPL control
+                                              * messages, num_parent_switch */
+#define TELEMETRY_REPORT_POWER_LEN        12
+
+#define TELEMETRY_REPORT_MAX_LEN          (TELEMETRY_REPORT_BASE_LEN + TELEMETRY_REPORT_POWER_LEN)
+
+/*---------------------------------------------------------------------------*/
+static inline void
+telemetry_report_put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+/*---------------------------------------------------------------------------*/
+static inline void
+telemetry_report_put32(uint8_t *p, uint32_t v)
+{
+  telemetry_report_put16(p, v);
+  telemetry_report_put16(p + 2, v >> 16);
+}
+/*---------------------------------------------------------------------------*/
+static inline uint16_t
+telemetry_report_get16(const uint8_t *p)
+{
+  return p[0] | (uint16_t)p[1] << 8;
+}
+/*---------------------------------------------------------------------------*/
+static inline uint32_t
+telemetry_report_get32(const uint8_t *p)
+{
+  return telemetry_report_get16(p) | (uint32_t)telemetry_report_get16(p + 2) << 16;
+}
+/*---------------------------------------------------------------------------*/
+/* Length of a valid report of len bytes, 0 if it is not one */
+static inline int
+telemetry_report_check(const uint8_t *r, int len)
+{
+  if(len < TELEMETRY_REPORT_BASE_LEN
+     || r[TELEMETRY_REPORT_VERSION_OFFSET] != TELEMETRY_REPORT_VERSION) {
+    return 0;
+  }
+  if(r[TELEMETRY_REPORT_FLAGS_OFFSET] & TELEMETRY_REPORT_FLAG_POWER) {
+    return len >= TELEMETRY_REPORT_MAX_LEN ? TELEMETRY_REPORT_MAX_LEN : 0;
+  }
+  return TELEMETRY_REPORT_BASE_LEN;
+}
+
+#endif /* __TELEMETRY_REPORT_H__ */
@@ -37,7 +37,7 @@
 #include "net/ip/uip-debug.h"
 
 
-#define MAX_PAYLOAD_LEN   100 
+#include "telemetry-report.h"
 
 
 
@@ -74,6 +74,14 @@ uint32_t delay_total = 0;
 uint8_t  self_addr1;
 uint8_t  self_addr2;
 
+/* Counters at the previous report, the report carries their deltas */
+static struct tsch_mac_stats last_mac;
+static uint16_t last_reply;
+static uint16_t last_drops[3];
+#if WITH_COMPOWER
+static uint16_t last_rpl[3];
+#endif
+
 uint16_t get_data_rate(void)
 {
    uint16_t myid = self_addr1 + self_addr2 * 256;
@@ -110,6 +118,14 @@ tcpip_handler(void)
   }
 }
 
+/*---------------------------------------------------------------------------*/
+/* Writes the delta of a counter since the previous report, and keeps the counter */
+static void
+report_put_delta(uint8_t *p, uint16_t value, uint16_t *last)
+{
+  telemetry_report_put16(p, value - *last);
+  *last = value;
+}
 /*---------------------------------------------------------------------------*/
 static void
 send_packet(void *ptr)
@@ -117,8 +133,13 @@ send_packet(void *ptr)
 
 // printf("send_packet()\n");
   rpl_instance_t *instance =rpl_get_default_instance();
-  
-  char buf[MAX_PAYLOAD_LEN];
+  rpl_parent_t *parent = instance != NULL && instance->current_dag != NULL
+                         ? instance->current_dag->preferred_parent : NULL;
+  uip_ipaddr_t *parent_ipaddr = parent != NULL ? rpl_get_parent_ipaddr(parent) : NULL;
+  static uint8_t report[TELEMETRY_REPORT_MAX_LEN];
+  uint8_t *r;
+  int len, d, s;
+
   current_time2 = clock_time(); 
   asn_time2 = (uint16_t) current_asn.ls4b; 
 
@@ -140,22 +161,54 @@ send_packet(void *ptr)
 //  PRINTF("Client: send to %d %d Message Hello %d\n",server_ipaddr.u8[sizeof(server_ipaddr.u8) - 2], server_ipaddr.u8[sizeof(server_ipaddr.u8) - 1], seq_id);  //modified
 
 
-int sz = sizeof(UIP_IP_BUF->srcipaddr.u8);
+  struct tsch_mac_stats mac;
+  if(!tsch_mac_stats_snapshot(&mac)) {
+    memcpy(&mac, &last_mac, sizeof(mac));
+  }
 
+  report[TELEMETRY_REPORT_VERSION_OFFSET] = TELEMETRY_REPORT_VERSION;
+  report[TELEMETRY_REPORT_FLAGS_OFFSET] = 0;
+  telemetry_report_put32(report + TELEMETRY_REPORT_SEQ_OFFSET, seq_id);
+  telemetry_report_put32(report + TELEMETRY_REPORT_ASN_OFFSET, current_asn.ls4b);
+  report[TELEMETRY_REPORT_ASN_OFFSET + 4] = current_asn.ms1b;
+  report[TELEMETRY_REPORT_PARENT_OFFSET] = parent_ipaddr != NULL ? parent_ipaddr->u8[14] : 0;
+  report[TELEMETRY_REPORT_PARENT_OFFSET + 1] = parent_ipaddr != NULL ? parent_ipaddr->u8[15] : 0;
+  telemetry_report_put16(report + TELEMETRY_REPORT_DELAY_OFFSET, delay_SC < 0xffff ? delay_SC : 0xffff);
+  telemetry_report_put16(report + TELEMETRY_REPORT_ETX_OFFSET,
+                         parent != NULL ? rpl_get_parent_link_stats(parent)->etx : 0);
+  report_put_delta(report + TELEMETRY_REPORT_REPLIES_OFFSET, reply, &last_reply);
+  r = report + TELEMETRY_REPORT_MAC_OFFSET;
+  for(d = 0; d < TSCH_MAC_STATS_NUM_DIRS; d++) {
+    for(s = 0; s < TSCH_MAC_STATS_NUM_STATUS; s++, r += 2) {
+      report_put_delta(r, mac.tx[d][s], &last_mac.tx[d][s]);
+    }
+  }
+  r = report + TELEMETRY_REPORT_DROPS_OFFSET;
+  report_put_delta(r, tsch_queue_overflow, &last_drops[0]);
+  report_put_delta(r + 2, num_pktdrop_queue, &last_drops[1]);
+  report_put_delta(r + 4, num_pktdrop_mac, &last_drops[2]);
+  len = TELEMETRY_REPORT_BASE_LEN;
 #if WITH_COMPOWER
+  report[TELEMETRY_REPORT_FLAGS_OFFSET] |= TELEMETRY_REPORT_FLAG_POWER;
+  r = report + TELEMETRY_REPORT_POWER_OFFSET;
+  telemetry_report_put16(r, dc_radio);
+  telemetry_report_put16(r + 2, dc_tx);
+  telemetry_report_put16(r + 4, dc_listen);
+  report_put_delta(r + 6, num_pktdrop_rpl, &last_rpl[0]);
+  report_put_delta(r + 8, num_dis + num_dio + num_dao + num_dao_ack, &last_rpl[1]);
+  report_put_delta(r + 10, num_parent_switch, &last_rpl[2]);
+  len += TELEMETRY_REPORT_POWER_LEN;
+#endif
 
-  sprintf(buf, "%u %u %u %u %u %d %d %d %d %d %d 0  %d  %d %d %u %u %u %u %u", seq_id, reply, asn_time2, rpl_get_parent_ipaddr(instance->current_dag->preferred_parent)->u8[sz-2], rpl_get_parent_ipaddr(instance->current_dag->preferred_parent)->u8[sz-1],    mac_tx_up_ok_counter,  mac_tx_up_error_counter, mac_tx_down_ok_counter, mac_tx_down_error_counter, tsch_queue_overflow, rpl_get_parent_link_stats(instance->current_dag->preferred_parent)->etx, dc_radio, dc_tx, dc_listen, num_pktdrop_queue, num_pktdrop_mac, num_pktdrop_rpl, num_dis+num_dio+num_dao+num_dao_ack, num_parent_switch);
+  uip_udp_packet_sendto(client_conn, report, len, &server_ipaddr, UIP_HTONS(UDP_SERVER_PORT));
 
+  /* The same, cumulative, on the serial log */
+#if WITH_COMPOWER
+  printf("S: %u %u %u %u %u %d %d %d %d %d %d 0  %d  %d %d %u %u %u %u %u \n", seq_id, reply, asn_time2, report[TELEMETRY_REPORT_PARENT_OFFSET], report[TELEMETRY_REPORT_PARENT_OFFSET + 1],    mac.tx[TSCH_MAC_STATS_UP][MAC_TX_OK],  tsch_mac_stats_errors(&mac, TSCH_MAC_STATS_UP), mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_OK], tsch_mac_stats_errors(&mac, TSCH_MAC_STATS_DOWN), tsch_queue_overflow, telemetry_report_get16(report + TELEMETRY_REPORT_ETX_OFFSET), dc_radio, dc_tx, dc_listen, num_pktdrop_queue, num_pktdrop_mac, num_pktdrop_rpl, num_dis+num_dio+num_dao+num_dao_ack, num_parent_switch);
 #else
-
-  sprintf(buf, "%u %u %u %u %d %d %d %d %d %d %d %d %d %d %d %d %d %d", seq_id, reply, asn_time2, delay_SC, rpl_get_parent_ipaddr(instance->current_dag->preferred_parent)->u8[sz-2], rpl_get_parent_ipaddr(instance->current_dag->preferred_parent)->u8[sz-1],    mac_tx_up_ok_counter, mac_tx_up_collision_counter, mac_tx_up_noack_counter, mac_tx_up_deferred_counter, mac_tx_up_err_counter, mac_tx_up_err_fatal_counter,      mac_tx_down_ok_counter, mac_tx_down_collision_counter, mac_tx_down_noack_counter, mac_tx_down_deferred_counter, mac_tx_down_err_counter, mac_tx_down_err_fatal_counter);
-
+  printf("S: %u %u %u %u %d %d %d %d %d %d %d %d %d %d %d %d %d %d \n", seq_id, reply, asn_time2, delay_SC, report[TELEMETRY_REPORT_PARENT_OFFSET], report[TELEMETRY_REPORT_PARENT_OFFSET + 1],    mac.tx[TSCH_MAC_STATS_UP][MAC_TX_OK], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_COLLISION], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_NOACK], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_DEFERRED], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_ERR], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_ERR_FATAL],      mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_OK], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_COLLISION], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_NOACK], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_DEFERRED], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_ERR], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_ERR_FATAL]);
 #endif
-
-
-  uip_udp_packet_sendto(client_conn, buf, strlen(buf), &server_ipaddr, UIP_HTONS(UDP_SERVER_PORT));
   delay_SC=300001; //reset e2e latency
-  printf("S: %s \n",buf);
 
 }
 /*---------------------------------------------------------------------------*/
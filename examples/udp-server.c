@@ -51,6 +51,7 @@
 #include "node-id.h"
 #include "net/ipv6/uip-ds6-route.h"
 #include "net/mac/tsch/tsch.h"
+#include "telemetry-report.h"
 #include "net/rpl/rpl-private.h"
 //#include "dev/temperature-sensor.h"
 //#include "board.h"
@@ -79,17 +80,40 @@
 
 
 #define MAX_PAYLOAD_LEN   20
-#define DISPLAY     50
+/* Statistics per source, in an open-addressing table keyed by the IPv6
+ * interface identifier of the source. Power of two, at least twice
+ * MAX_NODE_NUM to keep the probe sequences short */
+#ifdef SERVER_CONF_SOURCE_TABLE_SIZE
+#define SOURCE_TABLE_SIZE SERVER_CONF_SOURCE_TABLE_SIZE
+#elif MAX_NODE_NUM <= 32
+#define SOURCE_TABLE_SIZE 64
+#elif MAX_NODE_NUM <= 64
+#define SOURCE_TABLE_SIZE 128
+#else
+#define SOURCE_TABLE_SIZE 256
+#endif
+
+#if (SOURCE_TABLE_SIZE & (SOURCE_TABLE_SIZE - 1)) != 0
+#error SOURCE_TABLE_SIZE must be power of two
+#endif
 
-struct cal{
+#define SOURCE_IID_LEN 8
+
+struct source_stats {
+  uint8_t iid[SOURCE_IID_LEN];
   uint8_t enable;
-  uint16_t add;
-  uint16_t received;
-  uint32_t delay;
   uint8_t skip;
-} ;
+  uint16_t received;
+  uint16_t lost;        /* Reports missing from the seq sequence */
+  uint32_t last_seq;
+  uint16_t delay_min;   /* Client to server, in slots */
+  uint16_t delay_max;
+  uint32_t delay;       /* Sum */
+  struct asn_t last_asn; /* Send time of the last report */
+};
 
-struct cal statis[DISPLAY];
+static struct source_stats sources[SOURCE_TABLE_SIZE];
+static uint16_t num_sources;
 
 uint16_t print_count=0;
 
@@ -98,8 +122,6 @@ static int seq_id=1;
 
 clock_time_t current_time1=0;
 
-uint16_t asn_time1=0;
-
 uint16_t delay_CS=500; //client->server delay
 
 PROCESS(udp_server_process, "UDP server process");
@@ -122,31 +144,114 @@ uint16_t get_data_rate(uip_ipaddr_t routeip)
   }
 }
 
-uint16_t get_data_seq(uip_ipaddr_t routeip)
+/*---------------------------------------------------------------------------*/
+static uint16_t
+source_hash(const uint8_t *iid)
 {
+  uint32_t h = 0;
   int i;
-  uint16_t value = 0;
-  uint16_t myid = routeip.u8[15] + routeip.u8[14] * 256;
-  for(i=0; i<DISPLAY; i++)
-  {
-    if(statis[i].add == myid)
-    {
-      value = i+1;
-      break;
+  for(i = 0; i < SOURCE_IID_LEN; i++) {
+    h = h * 31 + iid[i];
+  }
+  /* Fibonacci hashing: sequential node ids spread over the table */
+  return (uint16_t)((uint32_t)(h * 2654435769UL) >> 16) & (SOURCE_TABLE_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the statistics of a source, added if add is set and there is room.
+ * NULL if none */
+static struct source_stats *
+source_lookup(const uip_ipaddr_t *addr, int add)
+{
+  const uint8_t *iid = &addr->u8[sizeof(addr->u8) - SOURCE_IID_LEN];
+  uint16_t h = source_hash(iid);
+  struct source_stats *s;
+
+  while((s = &sources[h])->enable) {
+    if(memcmp(s->iid, iid, SOURCE_IID_LEN) == 0) {
+      return s;
+    }
+    h = (h + 1) & (SOURCE_TABLE_SIZE - 1);
+  }
+  /* Keep an empty entry, the end of every probe sequence */
+  if(!add || num_sources >= SOURCE_TABLE_SIZE - 1) {
+    return NULL;
+  }
+  memset(s, 0, sizeof(*s));
+  memcpy(s->iid, iid, SOURCE_IID_LEN);
+  s->enable = 1;
+  s->delay_min = 0xffff;
+  num_sources++;
+  return s;
+}
+/*---------------------------------------------------------------------------*/
+/* Iterates over the sources: the first one after s, or the first one if s is NULL */
+static struct source_stats *
+source_next(struct source_stats *s)
+{
+  s = s == NULL ? sources : s + 1;
+  for(; s < &sources[SOURCE_TABLE_SIZE]; s++) {
+    if(s->enable) {
+      return s;
     }
-  } 
-  return value;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Accounts a report from a source */
+static void
+source_update(struct source_stats *s, uint32_t seq, uint16_t delay, const struct asn_t *sent_asn)
+{
+  if(s->received > 0 && seq > s->last_seq) {
+    s->lost += seq - s->last_seq - 1;
+  }
+  s->last_seq = seq;
+  s->received++;
+  s->delay += delay;
+  if(delay < s->delay_min) {
+    s->delay_min = delay;
+  }
+  if(delay > s->delay_max) {
+    s->delay_max = delay;
+  }
+  s->last_asn = *sent_asn;
 }
 
 void
 print_mac_states(){
+  struct tsch_mac_stats mac;
+
+  if(!tsch_mac_stats_snapshot(&mac)) {
+    memset(&mac, 0, sizeof(mac));
+  }
 
 #if WITH_COMPOWER & SERVER_WITH_COMPOWER
 
-  printf("mac: %d %d %d %d  %d  %d  %d  %u %u %u %u %u\n", mac_tx_up_ok_counter,  mac_tx_up_error_counter, mac_tx_down_ok_counter, mac_tx_down_error_counter, dc_radio, dc_tx, dc_listen,num_pktdrop_queue, num_pktdrop_mac, num_pktdrop_rpl, num_dis+num_dio+num_dao+num_dao_ack, tsch_queue_overflow);
+  printf("mac: %d %d %d %d  %d  %d  %d  %u %u %u %u %u\n", mac.tx[TSCH_MAC_STATS_UP][MAC_TX_OK], tsch_mac_stats_errors(&mac, TSCH_MAC_STATS_UP), mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_OK], tsch_mac_stats_errors(&mac, TSCH_MAC_STATS_DOWN), dc_radio, dc_tx, dc_listen,num_pktdrop_queue, num_pktdrop_mac, num_pktdrop_rpl, num_dis+num_dio+num_dao+num_dao_ack, tsch_queue_overflow);
 
 #else
-    PRINTF("m2 mactx: %d %d %d %d %d %d %d %d %d %d %d %d\n", mac_tx_up_ok_counter, mac_tx_up_collision_counter, mac_tx_up_noack_counter, mac_tx_up_deferred_counter, mac_tx_up_err_counter, mac_tx_up_err_fatal_counter,     mac_tx_down_ok_counter, mac_tx_down_collision_counter, mac_tx_down_noack_counter, mac_tx_down_deferred_counter, mac_tx_down_err_counter, mac_tx_down_err_fatal_counter);
+    PRINTF("m2 mactx: %d %d %d %d %d %d %d %d %d %d %d %d\n", mac.tx[TSCH_MAC_STATS_UP][MAC_TX_OK], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_COLLISION], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_NOACK], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_DEFERRED], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_ERR], mac.tx[TSCH_MAC_STATS_UP][MAC_TX_ERR_FATAL],     mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_OK], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_COLLISION], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_NOACK], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_DEFERRED], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_ERR], mac.tx[TSCH_MAC_STATS_DOWN][MAC_TX_ERR_FATAL]);
+#endif
+  /* Missed wakeups, active slots skipped, most per miss, lock skips, overloaded windows */
+  printf("slot misses: %lu %lu %u %lu %lu\n", (unsigned long)tsch_slot_misses.missed,
+         (unsigned long)tsch_slot_misses.skipped_slots, tsch_slot_misses.max_skipped,
+         (unsigned long)tsch_slot_misses.lock_skipped, (unsigned long)tsch_slot_misses.overloaded);
+
+#if TSCH_SCHEDULE_WITH_CELL_STATS
+  tsch_schedule_print_cell_stats();
+#endif
+
+#if TSCH_SLOT_TIMING
+  {
+    /* One line per slot phase: max, then the log2 buckets, in rtimer ticks */
+    int phase, b;
+    for(phase = 0; phase < TSCH_SLOT_PHASE_NUM; phase++) {
+      printf("slot timing %d: %lu", phase, (unsigned long)tsch_slot_timing.max[phase]);
+      for(b = 0; b < TSCH_SLOT_TIMING_BUCKETS; b++) {
+        printf(" %u", tsch_slot_timing.count[phase][b]);
+      }
+      printf("\n");
+    }
+  }
 #endif
 }
 
@@ -223,13 +328,16 @@ send_process1() /*For any experiment. Server sends msg to all nodes in its sub n
 #endif
 
   int n;
+  struct source_stats *source;
   print_count++;
   if(print_count%2 == 0)
   {
   printf("\n");
-  for(n=0; n<DISPLAY; n++)
+  for(n = 0, source = source_next(NULL); source != NULL; n++, source = source_next(source))
   {
-    PRINTF("n: %2u %3x.%3x re:  %3u %6u\n", n+1, (statis[n].add)/256, (statis[n].add)%256, statis[n].received, statis[n].delay);
+    PRINTF("n: %2u %3x.%3x re:  %3u %6lu lost %u min %u max %u\n", n+1, source->iid[6], source->iid[7],
+           source->received, (unsigned long)source->delay, source->lost,
+           source->received > 0 ? source->delay_min : 0, source->delay_max);
   }
   print_mac_states();
   printf("\n");
@@ -245,50 +353,31 @@ send_process1() /*For any experiment. Server sends msg to all nodes in its sub n
 static void
 tcpip_handler(void)
 {
-  char *appdata;
+  const uint8_t *report;
 
   current_time1 = clock_time();
-  asn_time1 = (uint16_t) current_asn.ls4b;
 
   if(uip_newdata()) {
-    appdata = (char *)uip_appdata;
-    appdata[uip_datalen()] = 0;
+    report = (const uint8_t *)uip_appdata;
+    if(!telemetry_report_check(report, uip_datalen())) {
+      PRINTF("Server: not a report, version %u len %u\n", uip_datalen() > 0 ? report[0] : 0, uip_datalen());
+      return;
+    }
 
   //  PRINTF("Server rxvs %s from %u %u time %u ", appdata, UIP_IP_BUF->srcipaddr.u8[sizeof(UIP_IP_BUF->srcipaddr.u8) - 2], UIP_IP_BUF->srcipaddr.u8[sizeof(UIP_IP_BUF->srcipaddr.u8) - 1], (uint16_t) current_asn.ls4b);  //modified
-    char *delim = " ";
-    strtok(appdata, delim);
-    strtok(NULL, delim);
-    char *p = strtok(NULL, delim);
-  //  printf("%s\n ", p);        
-    uint16_t sv_snt = (uint16_t)atoi(p); //client sent time 
-    if(sv_snt <= (uint16_t) asn_time1) {
-      delay_CS=(uint16_t)asn_time1 - sv_snt;
-    }
-    uint16_t addr;
-    addr = UIP_IP_BUF->srcipaddr.u8[sizeof(UIP_IP_BUF->srcipaddr.u8) - 2]*256 + UIP_IP_BUF->srcipaddr.u8[sizeof(UIP_IP_BUF->srcipaddr.u8) - 1]; 
- //   PRINTF("delay: %u addr = %x.%x\n", delay_CS,UIP_IP_BUF->srcipaddr.u8[sizeof(UIP_IP_BUF->srcipaddr.u8) - 2], UIP_IP_BUF->srcipaddr.u8[sizeof(UIP_IP_BUF->srcipaddr.u8) - 1]);
-    int m;
-    for(m=0; m<DISPLAY; m++)
-    {
-      if(statis[m].enable == 0)
-      {
-  statis[m].enable = 1;
-  statis[m].add = addr;
-  statis[m].received++;
-  statis[m].delay += delay_CS;
-  break;
-      }
-      else
-      {
-  if(statis[m].add == addr)
-  {
-    statis[m].received++;
-    statis[m].delay += delay_CS;
-    break;
-  }
-      }
+    struct asn_t sent_asn; //client sent time
+    uint32_t delay;
+    sent_asn.ls4b = telemetry_report_get32(report + TELEMETRY_REPORT_ASN_OFFSET);
+    sent_asn.ms1b = report[TELEMETRY_REPORT_ASN_OFFSET + 4];
+    /* Modulo 2^32, negative if the client ran ahead of the network time */
+    delay = current_asn.ls4b - sent_asn.ls4b;
+    delay_CS = (int32_t)delay < 0 ? 0 : (delay > 0xffff ? 0xffff : delay);
+    struct source_stats *source = source_lookup(&UIP_IP_BUF->srcipaddr, 1);
+    if(source != NULL) {
+      source_update(source, telemetry_report_get32(report + TELEMETRY_REPORT_SEQ_OFFSET), delay_CS, &sent_asn);
+    } else {
+      PRINTF("Server: source table full\n");
     }
- //   PRINTF("m: %u received: %u  total-delay: %u\n", m, statis[m].received, statis[m].delay);
 
 #if SERVER_REPLY
 #if ECHO_DOWNSTREAM_ENABLED
@@ -341,7 +430,7 @@ net_init(uip_ipaddr_t *br_prefix)
 PROCESS_THREAD(udp_server_process, ev, data)
 {
   static struct etimer et;
-  uint8_t seq;
+  struct source_stats *source;
 
 #if !ECHO_DOWNSTREAM_ENABLED
   static struct etimer periodic;
@@ -488,15 +577,8 @@ PROCESS_THREAD(udp_server_process, ev, data)
   PRINTF(" local/remote port %u/%u\n", UIP_HTONS(server_conn->lport),
          UIP_HTONS(server_conn->rport));
 
-  int k;
-  for(k=0; k<DISPLAY; k++)
-  {
-    statis[k].enable = 0;
-    statis[k].add = 0;
-    statis[k].received = 0;
-    statis[k].delay = 0;
-    statis[k].skip = 0;
-  }
+  memset(sources, 0, sizeof(sources));
+  num_sources = 0;
 
   while(1) {
     PROCESS_YIELD();
@@ -525,17 +607,17 @@ PROCESS_THREAD(udp_server_process, ev, data)
        break;
      case 2:
    
-       seq = get_data_seq(route_copy_list[num_child-1]);
-       if(seq > 0)
+       source = source_lookup(&route_copy_list[num_child-1], 0);
+       if(source != NULL)
        {
-          if(statis[seq-1].skip > 0)
+          if(source->skip > 0)
           {
-            statis[seq-1].skip--;     
+            source->skip--;     
             num_child-=1; 
           }
           else
           {
-            statis[seq-1].skip = 1;
+            source->skip = 1;
             send_packet(&route_copy_list[num_child-1]);
           }
        }
@@ -545,17 +627,17 @@ PROCESS_THREAD(udp_server_process, ev, data)
        }
        break;
      case 4:
-       seq = get_data_seq(route_copy_list[num_child-1]);
-       if(seq > 0)
+       source = source_lookup(&route_copy_list[num_child-1], 0);
+       if(source != NULL)
        {
-          if(statis[seq-1].skip > 0)
+          if(source->skip > 0)
           {
-            statis[seq-1].skip--;
+            source->skip--;
             num_child-=1;
           }
           else
           {
-            statis[seq-1].skip = 3;
+            source->skip = 3;
             send_packet(&route_copy_list[num_child-1]);
           }
         }
@@ -0,0 +1,553 @@
+/*
+ * Offline ATRIA schedule simulator. Loads a parent map, derives the routes
+ * through every link and places the cells of every link with the planner of
+ * the ATRIA rule (atria_plan_cells), for a sweep of ASFNs split across
+ * threads. ASFNs wrap as in the rule, at 65535 / ORCHESTRA_UNICAST_PERIOD,
+ * so a sweep beyond that repeats the slotframes of a real network. Reports,
+ * per link and for the network:
+ *   cells     scheduled cells per slotframe, upstream and downstream
+ *   collide   % of cells sharing (timeslot, channel offset) with a link
+ *             closer than the interference radius (tree hops between endpoints)
+ *   up, down  expected wait of a packet for the next cell, in timeslots
+ * plus the cell utilization of the slotframe and the upstream end-to-end
+ * wait of every node. Cells placed beyond the slotframe, as the empty first
+ * block of a link with more cells than sub-periods can be, never fire and
+ * are counted as lost.
+ *
+ * The parent map has one "child parent" pair of node ids per line, decimal
+ * or 0x-prefixed hex, as in get_fixed_rpl_parent_id(): lines such as
+ * "case 0xb280: return 0x9183; break;" are accepted as they are. '#' and
+ * '//' start comments.
+ *
+ * Usage: atria-sim [-n num_asfn] [-j threads] [-r radius] [-v] map_file
+ *        atria-sim [-n num_asfn] [-j threads] [-r radius] [-v] -g num_nodes
+ */
+
+#include "contiki.h"
+#include "orchestra.h"
+#include "atria-planner.h"
+#include "native.h"
+#include "net/mac/tsch/tsch.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef printf
+
+#define MAX_NODES   65536
+#define NO_NODE     0xffff
+#define SLOT_MS     10 /* TSCH default timeslot length */
+/* Distinct ASFNs of the rule, which wraps them as atria_next_asfn() does */
+#define NUM_ASFN    (65535 / ORCHESTRA_UNICAST_PERIOD + 1)
+/* Up to this many links, interference is tabulated before the sweep */
+#define MAX_TABLE_LINKS 16384
+
+struct node {
+  uint16_t id;
+  uint16_t parent;  /* node index, NO_NODE for a root */
+  uint16_t depth;
+  uint32_t routes;  /* routes through the link to the parent, itself included */
+};
+
+/* A link's cells in one slotframe, as the planner takes them */
+struct link {
+  uint16_t child;    /* node index */
+  uint16_t hash_up;  /* ORCHESTRA_LINKADDR_HASH2(child, parent) */
+  uint16_t hash_down;
+  uint16_t schedule_num;
+};
+
+/* Accumulated over the ASFNs of a thread */
+struct link_stats {
+  uint64_t cells;
+  uint64_t lost;
+  uint64_t collided;
+  double wait_up;
+  double wait_down;
+};
+
+struct cell {
+  uint16_t timeslot;
+  uint16_t channel_offset;
+  uint32_t link;
+};
+
+struct worker {
+  pthread_t thread;
+  uint32_t first_asfn;
+  uint32_t num_asfn;
+  struct link_stats *stats;
+  double used_cells;
+};
+
+static struct node *nodes;
+static uint32_t num_nodes;
+static struct link *links;
+static uint32_t num_links;
+static uint32_t max_cells;
+static int radius = 1;
+static int num_ch;
+static uint64_t *interference; /* Row l1, bit l2: the links interfere */
+static uint32_t row_words;
+/*---------------------------------------------------------------------------*/
+static uint16_t
+node_index(uint16_t id, int add)
+{
+  static uint16_t *index;
+  uint32_t i;
+
+  if(index == NULL) {
+    index = malloc(MAX_NODES * sizeof(uint16_t));
+    for(i = 0; i < MAX_NODES; i++) {
+      index[i] = NO_NODE;
+    }
+  }
+  if(index[id] == NO_NODE && add && num_nodes < NO_NODE) {
+    nodes[num_nodes].id = id;
+    nodes[num_nodes].parent = NO_NODE;
+    index[id] = num_nodes++;
+  }
+  return index[id];
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_pair(uint16_t child, uint16_t parent)
+{
+  uint16_t c = node_index(child, 1);
+  uint16_t p = node_index(parent, 1);
+
+  if(c != NO_NODE && p != NO_NODE && c != p) {
+    nodes[c].parent = p;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+load_map(const char *path)
+{
+  char line[256], *p, *end;
+  long v[2];
+  int n;
+  FILE *f = fopen(path, "r");
+
+  if(f == NULL) {
+    perror(path);
+    return 0;
+  }
+  while(fgets(line, sizeof(line), f) != NULL) {
+    if((p = strchr(line, '#')) != NULL || (p = strstr(line, "//")) != NULL) {
+      *p = '\0';
+    }
+    /* The first two numbers of the line */
+    for(n = 0, p = line; n < 2 && *p != '\0';) {
+      if(isdigit((unsigned char)*p)) {
+        v[n++] = strtol(p, &end, 0);
+        p = end;
+      } else if(isalpha((unsigned char)*p) || *p == '_') {
+        while(isalnum((unsigned char)*p) || *p == '_') {
+          p++;
+        }
+      } else {
+        p++;
+      }
+    }
+    if(n == 2) {
+      add_pair(v[0], v[1]);
+    }
+  }
+  fclose(f);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* A random tree: node i (ids from 2) picks its parent among the nodes before it */
+static void
+generate_map(uint32_t n)
+{
+  uint32_t i;
+
+  srand(1);
+  node_index(1, 1);
+  for(i = 1; i < n && i < NO_NODE - 1; i++) {
+    add_pair(i + 1, (rand() % i) + 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+build_links(void)
+{
+  uint32_t i, hops;
+  uint16_t n;
+  linkaddr_t child, parent;
+
+  /* Depths, and routes by walking up from every node */
+  for(i = 0; i < num_nodes; i++) {
+    for(n = i, hops = 0; nodes[n].parent != NO_NODE; n = nodes[n].parent) {
+      nodes[n].routes++;
+      if(++hops > num_nodes) {
+        fprintf(stderr, "loop in the parent map at node 0x%04x\n", nodes[i].id);
+        return 0;
+      }
+    }
+    nodes[i].depth = hops;
+  }
+
+  links = calloc(num_nodes, sizeof(struct link));
+  for(i = 0; i < num_nodes; i++) {
+    if(nodes[i].parent == NO_NODE) {
+      continue;
+    }
+    native_linkaddr(&child, nodes[i].id);
+    native_linkaddr(&parent, nodes[nodes[i].parent].id);
+    links[num_links].child = i;
+    links[num_links].hash_up = ORCHESTRA_LINKADDR_HASH2(&child, &parent);
+    links[num_links].hash_down = ORCHESTRA_LINKADDR_HASH2(&parent, &child);
+    /* As the rule: 2 cells per route through the child, upstream first */
+    links[num_links].schedule_num = nodes[i].routes * 2 > 0xffff ? 0xfffe : nodes[i].routes * 2;
+    max_cells += links[num_links].schedule_num;
+    num_links++;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tree_distance(uint16_t a, uint16_t b)
+{
+  int d = 0;
+
+  while(nodes[a].depth > nodes[b].depth) {
+    a = nodes[a].parent;
+    d++;
+  }
+  while(nodes[b].depth > nodes[a].depth) {
+    b = nodes[b].parent;
+    d++;
+  }
+  while(a != b) {
+    a = nodes[a].parent;
+    b = nodes[b].parent;
+    d += 2;
+  }
+  return d;
+}
+/*---------------------------------------------------------------------------*/
+/* Links interfere if any of their endpoints are within radius hops */
+static int
+links_interfere(uint32_t l1, uint32_t l2)
+{
+  uint16_t a = links[l1].child, b = links[l2].child;
+  int d = tree_distance(a, b);
+
+  /* The parents are at most one hop closer each */
+  if(d > radius + 2) {
+    return 0;
+  }
+  return d <= radius
+         || tree_distance(nodes[a].parent, b) <= radius
+         || tree_distance(a, nodes[b].parent) <= radius
+         || tree_distance(nodes[a].parent, nodes[b].parent) <= radius;
+}
+/*---------------------------------------------------------------------------*/
+static void
+build_interference(void)
+{
+  uint32_t l1, l2;
+
+  if(num_links > MAX_TABLE_LINKS) {
+    return;
+  }
+  row_words = (num_links + 63) / 64;
+  interference = calloc((uint64_t)num_links * row_words, sizeof(uint64_t));
+  for(l1 = 0; l1 < num_links; l1++) {
+    for(l2 = l1 + 1; l2 < num_links; l2++) {
+      if(links_interfere(l1, l2)) {
+        interference[(uint64_t)l1 * row_words + l2 / 64] |= 1ull << (l2 % 64);
+        interference[(uint64_t)l2 * row_words + l1 / 64] |= 1ull << (l1 % 64);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Expected wait for the next of the sorted timeslots, arrivals uniform over
+ * the slotframe and the schedule repeating */
+static double
+expected_wait(const uint16_t *ts, uint16_t n)
+{
+  double sum = 0;
+  uint32_t gap;
+  uint16_t i;
+
+  if(n == 0) {
+    return ORCHESTRA_UNICAST_PERIOD; /* No cell in this slotframe */
+  }
+  for(i = 0; i < n; i++) {
+    gap = i + 1 < n ? ts[i + 1] - ts[i] : ts[0] + ORCHESTRA_UNICAST_PERIOD - ts[i];
+    sum += (double)gap * gap;
+  }
+  return sum / (2.0 * ORCHESTRA_UNICAST_PERIOD);
+}
+/*---------------------------------------------------------------------------*/
+/* Blocks ascend with cell_seq, so the timeslots come nearly sorted */
+static void
+sort_timeslots(uint16_t *ts, uint16_t n)
+{
+  uint16_t i, j, v;
+
+  for(i = 1; i < n; i++) {
+    v = ts[i];
+    for(j = i; j > 0 && ts[j - 1] > v; j--) {
+      ts[j] = ts[j - 1];
+    }
+    ts[j] = v;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void *
+worker_run(void *arg)
+{
+  struct worker *w = arg;
+  uint32_t grid = ORCHESTRA_UNICAST_PERIOD * num_ch;
+  uint32_t *bucket = malloc((grid + 1) * sizeof(uint32_t));
+  struct cell *cells = malloc(max_cells * sizeof(struct cell));
+  struct cell *sorted = malloc(max_cells * sizeof(struct cell));
+  uint8_t *hit = malloc(max_cells);
+  uint16_t *seq = malloc(65536 * sizeof(uint16_t));
+  uint16_t *sn = malloc(65536 * sizeof(uint16_t));
+  uint16_t *hash = malloc(65536 * sizeof(uint16_t));
+  uint16_t *ts = malloc(65536 * sizeof(uint16_t));
+  uint16_t *choff = malloc(65536 * sizeof(uint16_t));
+  uint16_t *up = malloc(65536 * sizeof(uint16_t));
+  uint16_t *down = malloc(65536 * sizeof(uint16_t));
+  uint64_t *present = calloc(row_words + 1, sizeof(uint64_t));
+  uint32_t *words = malloc(max_cells * sizeof(uint32_t));
+  const uint64_t *row;
+  uint32_t num_words;
+  uint32_t asfn, l, i, j, k, n, num_cells, used;
+  uint16_t num_up, num_down;
+  struct link_stats *s;
+
+  for(asfn = w->first_asfn; asfn < w->first_asfn + w->num_asfn; asfn++) {
+    /* The cells of every link, through the rule's planner */
+    num_cells = 0;
+    for(l = 0; l < num_links; l++) {
+      n = links[l].schedule_num;
+      for(i = 0; i < n; i++) {
+        seq[i] = i + 1;
+        sn[i] = n;
+        hash[i] = (i % 2 == 0) ? links[l].hash_up : links[l].hash_down;
+      }
+      atria_plan_cells(asfn % NUM_ASFN, n, hash, seq, sn, ts, choff);
+
+      s = &w->stats[l];
+      num_up = num_down = 0;
+      for(i = 0; i < n; i++) {
+        s->cells++;
+        if(ts[i] >= ORCHESTRA_UNICAST_PERIOD) {
+          s->lost++;
+          continue;
+        }
+        cells[num_cells].timeslot = ts[i];
+        cells[num_cells].channel_offset = choff[i];
+        cells[num_cells].link = l;
+        num_cells++;
+        if(i % 2 == 0) {
+          up[num_up++] = ts[i];
+        } else {
+          down[num_down++] = ts[i];
+        }
+      }
+      sort_timeslots(up, num_up);
+      sort_timeslots(down, num_down);
+      s->wait_up += expected_wait(up, num_up);
+      s->wait_down += expected_wait(down, num_down);
+    }
+
+    /* Bucket the cells by (timeslot, channel offset) */
+    memset(bucket, 0, (grid + 1) * sizeof(uint32_t));
+    for(i = 0; i < num_cells; i++) {
+      bucket[cells[i].timeslot * num_ch + cells[i].channel_offset - 1 + 1]++;
+    }
+    for(k = 0, used = 0; k < grid; k++) {
+      used += bucket[k + 1] > 0;
+      bucket[k + 1] += bucket[k];
+    }
+    w->used_cells += used;
+    for(i = 0; i < num_cells; i++) {
+      sorted[bucket[cells[i].timeslot * num_ch + cells[i].channel_offset - 1]++] = cells[i];
+    }
+
+    /* Within a bucket, a cell collides if an interfering link shares it */
+    memset(hit, 0, num_cells);
+    for(i = 0; i < num_cells; i = j) {
+      for(j = i + 1; j < num_cells && sorted[j].timeslot == sorted[i].timeslot
+          && sorted[j].channel_offset == sorted[i].channel_offset; j++);
+      if(interference != NULL) {
+        /* The links of the bucket as a bitset, ANDed with each link's row */
+        for(k = i, num_words = 0; k < j; k++) {
+          n = sorted[k].link / 64;
+          if(present[n] == 0) {
+            words[num_words++] = n;
+          }
+          present[n] |= 1ull << (sorted[k].link % 64);
+        }
+        for(k = i; k < j; k++) {
+          row = &interference[(uint64_t)sorted[k].link * row_words];
+          for(n = 0; n < num_words && (row[words[n]] & present[words[n]]) == 0; n++);
+          hit[k] = n < num_words;
+        }
+        for(n = 0; n < num_words; n++) {
+          present[words[n]] = 0;
+        }
+      } else {
+        for(k = i; k < j; k++) {
+          for(n = k + 1; n < j; n++) {
+            if(sorted[k].link != sorted[n].link
+               && (!hit[k] || !hit[n]) && links_interfere(sorted[k].link, sorted[n].link)) {
+              hit[k] = hit[n] = 1;
+            }
+          }
+        }
+      }
+      for(k = i; k < j; k++) {
+        w->stats[sorted[k].link].collided += hit[k];
+      }
+    }
+  }
+
+  free(bucket);
+  free(cells);
+  free(sorted);
+  free(hit);
+  free(seq);
+  free(sn);
+  free(hash);
+  free(ts);
+  free(choff);
+  free(up);
+  free(down);
+  free(present);
+  free(words);
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  struct worker *workers;
+  struct link_stats *total;
+  uint32_t num_asfn = 10000, generate = 0;
+  uint32_t i, l, t, num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t cells = 0, lost = 0, collided = 0;
+  double used = 0, wait_up = 0, wait_down = 0, worst = 0, e2e, e2e_sum = 0, e2e_max = 0;
+  double *link_wait_up;
+  struct timespec start, end;
+  uint16_t n;
+  int verbose = 0, opt;
+
+  while((opt = getopt(argc, argv, "n:j:r:g:v")) != -1) {
+    switch(opt) {
+    case 'n': num_asfn = atoi(optarg); break;
+    case 'j': num_threads = atoi(optarg); break;
+    case 'r': radius = atoi(optarg); break;
+    case 'g': generate = atoi(optarg); break;
+    case 'v': verbose = 1; break;
+    default: goto usage;
+    }
+  }
+  if(num_asfn < 1 || num_threads < 1 || radius < 0 || (generate == 0 && optind != argc - 1)) {
+    goto usage;
+  }
+
+  num_ch = (sizeof(TSCH_DEFAULT_HOPPING_SEQUENCE)/sizeof(uint8_t))-1;
+  nodes = calloc(MAX_NODES, sizeof(struct node));
+  if(generate > 0) {
+    generate_map(generate);
+  } else if(!load_map(argv[optind])) {
+    return 1;
+  }
+  if(!build_links() || num_links == 0) {
+    fprintf(stderr, "no links in the parent map\n");
+    return 1;
+  }
+  if(num_threads > num_asfn) {
+    num_threads = num_asfn;
+  }
+  build_interference();
+
+  /* Contiguous ASFN ranges, one per thread */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  workers = calloc(num_threads, sizeof(struct worker));
+  for(t = 0; t < num_threads; t++) {
+    workers[t].first_asfn = (uint64_t)num_asfn * t / num_threads;
+    workers[t].num_asfn = (uint64_t)num_asfn * (t + 1) / num_threads - workers[t].first_asfn;
+    workers[t].stats = calloc(num_links, sizeof(struct link_stats));
+    pthread_create(&workers[t].thread, NULL, worker_run, &workers[t]);
+  }
+  total = calloc(num_links, sizeof(struct link_stats));
+  for(t = 0; t < num_threads; t++) {
+    pthread_join(workers[t].thread, NULL);
+    for(l = 0; l < num_links; l++) {
+      total[l].cells += workers[t].stats[l].cells;
+      total[l].lost += workers[t].stats[l].lost;
+      total[l].collided += workers[t].stats[l].collided;
+      total[l].wait_up += workers[t].stats[l].wait_up;
+      total[l].wait_down += workers[t].stats[l].wait_down;
+    }
+    used += workers[t].used_cells;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if(verbose) {
+    printf("%6s %6s %6s %8s %8s %8s\n", "child", "parent", "cells", "collide", "up", "down");
+  }
+  link_wait_up = calloc(num_nodes, sizeof(double));
+  for(l = 0; l < num_links; l++) {
+    struct link_stats *s = &total[l];
+    double rate = s->cells > s->lost ? 100.0 * s->collided / (s->cells - s->lost) : 0;
+    cells += s->cells;
+    lost += s->lost;
+    collided += s->collided;
+    wait_up += s->wait_up / num_asfn;
+    wait_down += s->wait_down / num_asfn;
+    link_wait_up[links[l].child] = s->wait_up / num_asfn;
+    if(rate > worst) {
+      worst = rate;
+    }
+    if(verbose) {
+      printf("0x%04x 0x%04x %6.1f %7.2f%% %8.1f %8.1f\n", nodes[links[l].child].id,
+             nodes[nodes[links[l].child].parent].id, (double)s->cells / num_asfn, rate,
+             s->wait_up / num_asfn, s->wait_down / num_asfn);
+    }
+  }
+  for(i = 0; i < num_nodes; i++) {
+    for(n = i, e2e = 0; nodes[n].parent != NO_NODE; n = nodes[n].parent) {
+      e2e += link_wait_up[n];
+    }
+    e2e_sum += e2e;
+    if(e2e > e2e_max) {
+      e2e_max = e2e;
+    }
+  }
+
+  printf("nodes %u, links %u, slotframes %u, %u threads, %.2f s\n", num_nodes, num_links,
+         num_asfn, num_threads,
+         (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+  printf("cells/slotframe %.1f, lost (beyond the slotframe) %.2f%%, utilization %.2f%% of %u cells\n",
+         (double)cells / num_asfn, cells > 0 ? 100.0 * lost / cells : 0,
+         100.0 * used / num_asfn / (ORCHESTRA_UNICAST_PERIOD * num_ch),
+         ORCHESTRA_UNICAST_PERIOD * num_ch);
+  printf("collision (radius %d hops) %.2f%%, worst link %.2f%%\n", radius,
+         cells > lost ? 100.0 * collided / (cells - lost) : 0, worst);
+  printf("per-hop wait: up %.1f, down %.1f timeslots (%.0f, %.0f ms)\n",
+         wait_up / num_links, wait_down / num_links,
+         wait_up / num_links * SLOT_MS, wait_down / num_links * SLOT_MS);
+  printf("end-to-end upstream wait: mean %.1f, max %.1f timeslots (%.0f, %.0f ms)\n",
+         e2e_sum / num_nodes, e2e_max, e2e_sum / num_nodes * SLOT_MS, e2e_max * SLOT_MS);
+  return 0;
+
+usage:
+  fprintf(stderr, "usage: %s [-n num_asfn] [-j threads] [-r radius] [-v] map_file | -g num_nodes\n", argv[0]);
+  return 1;
+}
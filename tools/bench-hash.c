@@ -0,0 +1,216 @@
+/*
+ * Host benchmark of the cell hash (real_hash) selected by TSCH_CONF_CELL_HASH
+ * and TSCH_CONF_CELL_HASH_UNBIASED. Replays the ATRIA cells of the fixed
+ * testbed topology of get_fixed_rpl_parent_id() (rpl/rpl.c) over a range of
+ * ASFNs and reports:
+ *   ns/hash   real_hash() over the unicast slotframe
+ *   cells     ATRIA cells per slotframe, all links
+ *   collide   % of cells sharing (timeslot, channel offset) with another link
+ *   sibling   same, counting only links towards the same parent
+ *   max       worst slotframe of collide
+ *   repeat    % of colliding link pairs that collide again in the next slotframe
+ *
+ * Usage: bench-hash [--header] [num_asfn]
+ */
+
+#include "contiki.h"
+#include "orchestra.h"
+#include "atria-planner.h"
+#include "net/mac/tsch/tsch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#undef printf
+
+#if TSCH_CELL_HASH == TSCH_CELL_HASH_WANG
+#define HASH_NAME "wang"
+#elif TSCH_CELL_HASH == TSCH_CELL_HASH_MURMUR3
+#define HASH_NAME "murmur3"
+#else
+#define HASH_NAME "xorshift"
+#endif
+
+#define ROOT_ID 0x9183
+
+/* Child -> preferred parent, as in get_fixed_rpl_parent_id() */
+static const uint16_t topology[][2] = {
+  { 0xb280, 0x9183 }, { 0x8472, 0x8875 }, { 0xb481, 0xb280 }, { 0x2160, 0xb280 },
+  { 0x9567, 0xb280 }, { 0x9175, 0xb280 }, { 0xb369, 0xb280 }, { 0xb582, 0xb280 },
+  { 0xb268, 0xb280 }, { 0xa372, 0xb268 }, { 0xb180, 0xb268 }, { 0x9377, 0xb268 },
+  { 0x9283, 0xb268 }, { 0x3861, 0xb268 }, { 0x2362, 0xa372 }, { 0x9481, 0xa372 },
+  { 0xa677, 0xa372 }, { 0xa083, 0xa372 }, { 0x9579, 0xa372 }, { 0x9077, 0xa372 },
+  { 0xb881, 0x9077 }, { 0xb383, 0x9579 }, { 0xb580, 0xb881 }, { 0x8982, 0xb383 },
+  { 0x8669, 0x9183 }, { 0x9475, 0x9183 }, { 0x9467, 0x9183 }, { 0x1362, 0x8669 },
+  { 0xa079, 0x8669 }, { 0xb569, 0x8669 }, { 0x8876, 0xa079 }, { 0xa675, 0xa079 },
+  { 0x9271, 0xa079 }, { 0xa370, 0xa079 }, { 0x8877, 0xa675 }, { 0x8871, 0xa675 },
+  { 0x9479, 0xa675 }, { 0xa082, 0xa675 }, { 0xb083, 0x8877 }, { 0xc368, 0x8877 },
+  { 0xc169, 0x8871 }, { 0xa570, 0x8871 }, { 0x9076, 0x9183 }, { 0xb379, 0x9076 },
+  { 0x8875, 0x9076 }, { 0xb877, 0x9183 }, { 0x8967, 0xb877 }, { 0xa078, 0x9183 },
+  { 0xa379, 0x9183 }, { 0xc081, 0x9183 }, { 0x9584, 0xc081 }, { 0xa183, 0xc081 },
+  { 0xc376, 0x9584 }, { 0x8569, 0x9584 }, { 0xa383, 0x9584 }, { 0xa972, 0xc376 },
+  { 0xa768, 0xc376 }, { 0xa670, 0xa383 }, { 0xa376, 0x8569 }, { 0xb579, 0xa383 },
+};
+#define NUM_LINKS (sizeof(topology) / sizeof(topology[0]))
+#define MAX_CELLS (TSCH_SCHEDULE_MAX_LINKS * 8)
+
+struct cell {
+  uint16_t timeslot;
+  uint16_t channel_offset;
+  uint8_t link;
+};
+
+static struct cell cells[MAX_CELLS];
+static int num_cells;
+/* Routes through each link's child, the child included */
+static uint16_t routes[NUM_LINKS];
+static uint8_t collided[2][NUM_LINKS][NUM_LINKS];
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+id_to_linkaddr(linkaddr_t *addr, uint16_t id)
+{
+  memset(addr, 0, sizeof(linkaddr_t));
+  addr->u8[LINKADDR_SIZE - 2] = id >> 8;
+  addr->u8[LINKADDR_SIZE - 1] = id & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_routes(void)
+{
+  unsigned i, j;
+  uint16_t id;
+
+  for(i = 0; i < NUM_LINKS; i++) {
+    /* Walk up from each node, counting it once at every link on its path */
+    id = topology[i][0];
+    while(id != ROOT_ID) {
+      for(j = 0; j < NUM_LINKS && topology[j][0] != id; j++);
+      if(j == NUM_LINKS) {
+        break;
+      }
+      routes[j]++;
+      id = topology[j][1];
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The cells of every link for one ASFN, as the ATRIA rule installs them */
+static void
+plan_cells(uint16_t asfn)
+{
+  linkaddr_t child, parent;
+  uint16_t schedule_num, i;
+  unsigned l;
+
+  num_cells = 0;
+  for(l = 0; l < NUM_LINKS; l++) {
+    id_to_linkaddr(&child, topology[l][0]);
+    id_to_linkaddr(&parent, topology[l][1]);
+    schedule_num = routes[l] * 2;
+    for(i = 1; i <= schedule_num && num_cells < MAX_CELLS; i++) {
+      if(atria_plan_cell(i % 2 ? &child : &parent, i % 2 ? &parent : &child, asfn, i, schedule_num,
+                         &cells[num_cells].timeslot, &cells[num_cells].channel_offset)) {
+        cells[num_cells++].link = l;
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static double
+bench_hash(void)
+{
+  volatile uint16_t sink = 0;
+  uint64_t t;
+  uint32_t v;
+
+  t = now_ns();
+  for(v = 0; v < 1000000; v++) {
+    sink += real_hash((uint16_t)v, ORCHESTRA_UNICAST_PERIOD);
+  }
+  (void)sink;
+  return (double)(now_ns() - t) / 1000000;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  unsigned long total_cells = 0, total_collide = 0, total_sibling = 0;
+  unsigned long pairs = 0, repeats = 0;
+  double max_collide = 0, rate;
+  int num_asfn = 1000;
+  int asfn, i, j, collide, sibling, cur;
+  uint8_t a, b;
+
+  if(argc > 1 && strcmp(argv[1], "--header") == 0) {
+    printf("%-9s %8s %8s %6s %8s %8s %8s %8s\n", "hash", "unbiased", "ns/hash",
+           "cells", "collide", "sibling", "max", "repeat");
+    return 0;
+  }
+  if(argc > 1) {
+    num_asfn = atoi(argv[1]);
+  }
+  if(num_asfn < 2) {
+    fprintf(stderr, "usage: %s [--header] [num_asfn]\n", argv[0]);
+    return 1;
+  }
+
+  count_routes();
+  for(asfn = 0; asfn < num_asfn; asfn++) {
+    cur = asfn & 1;
+    memset(collided[cur], 0, sizeof(collided[cur]));
+    plan_cells(asfn);
+
+    collide = sibling = 0;
+    for(i = 0; i < num_cells; i++) {
+      int hit = 0, sibling_hit = 0;
+      for(j = 0; j < num_cells; j++) {
+        a = cells[i].link;
+        b = cells[j].link;
+        if(a != b && cells[i].timeslot == cells[j].timeslot
+           && cells[i].channel_offset == cells[j].channel_offset) {
+          hit = 1;
+          if(topology[a][1] == topology[b][1]) {
+            sibling_hit = 1;
+          }
+          collided[cur][a][b] = 1;
+        }
+      }
+      collide += hit;
+      sibling += sibling_hit;
+    }
+
+    if(asfn > 0) {
+      for(a = 0; a < NUM_LINKS; a++) {
+        for(b = a + 1; b < NUM_LINKS; b++) {
+          if(collided[!cur][a][b]) {
+            pairs++;
+            repeats += collided[cur][a][b];
+          }
+        }
+      }
+    }
+
+    total_cells += num_cells;
+    total_collide += collide;
+    total_sibling += sibling;
+    rate = num_cells > 0 ? 100.0 * collide / num_cells : 0;
+    if(rate > max_collide) {
+      max_collide = rate;
+    }
+  }
+
+  printf("%-9s %8d %8.2f %6lu %7.2f%% %7.2f%% %7.2f%% %7.2f%%\n", HASH_NAME, TSCH_CELL_HASH_UNBIASED,
+         bench_hash(), total_cells / num_asfn,
+         100.0 * total_collide / total_cells, 100.0 * total_sibling / total_cells,
+         max_collide, pairs > 0 ? 100.0 * repeats / pairs : 0);
+  return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Host microbenchmarks of the TSCH schedule, the TSCH queue and the ATRIA
+ * unicast rule, built against the stubs in native/. For each number of
+ * RPL children (one route each), reports ns/op of:
+ *   next_link   tsch_schedule_get_next_active_link(), walking the ASN
+ *               forward as the slot operation would
+ *   sf_start    the ATRIA slotframe start callback (installs the cells)
+ *   plan        computing the plan of the next slotframe (process side)
+ *   reschedule  a full unicast slotframe reschedule, as on a routing change
+ *   pkt_for_nbr tsch_queue_get_packet_for_nbr() on a unicast link, over the
+ *               neighbors holding a packet
+ *
+ * Usage: bench-native [max_children [step [iterations]]]
+ */
+
+#include "contiki.h"
+#include "orchestra.h"
+#include "native.h"
+#include "net/nbr-table.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/tsch/tsch-queue.h"
+#include "net/mac/tsch/tsch-schedule.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#undef printf
+
+#define NODE_ID   2
+#define PARENT_ID 1
+#define CHILD_ID(i) (0x100 + (i))
+
+void tsch_queue_init(void);
+
+static int iterations = 2000;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+/* Builds a node with a parent and n children, and its ATRIA schedule */
+static void
+setup(int n)
+{
+  linkaddr_t addr;
+  int i;
+
+  tsch_schedule_remove_all_slotframes();
+  tsch_queue_reset();
+  native_routes_clear();
+
+  native_linkaddr(&addr, NODE_ID);
+  linkaddr_set_node_addr(&addr);
+  native_linkaddr(&orchestra_parent_linkaddr, PARENT_ID);
+  native_set_rank(512);
+
+  unicast_per_neighbor_rpl_storing.init(ALICE_UNICAST_SF_ID);
+  for(i = 0; i < n; i++) {
+    native_linkaddr(&addr, CHILD_ID(i));
+    native_routes_add(&addr, 1);
+  }
+  native_linkaddr(&addr, CHILD_ID(0));
+  unicast_per_neighbor_rpl_storing.child_added(&addr, 1);
+  native_process_run();
+}
+/*---------------------------------------------------------------------------*/
+static double
+bench_next_link(void)
+{
+  struct asn_t asn;
+  struct tsch_link *backup;
+  uint16_t offset;
+  uint64_t t, total = 0;
+  int i;
+
+  ASN_INIT(asn, 0, 0);
+  for(i = 0; i < iterations; i++) {
+    t = now_ns();
+    tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+    total += now_ns() - t;
+    /* The plan process runs between slots */
+    native_process_run();
+    ASN_INC(asn, offset > 0 ? offset : 1);
+  }
+  return (double)total / iterations;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_sf_start(double *sf_start, double *plan)
+{
+  uint64_t t, total_start = 0, total_plan = 0;
+  int i;
+
+  for(i = 0; i < iterations; i++) {
+    t = now_ns();
+    alice_callback_slotframe_start(i + 1, ORCHESTRA_UNICAST_PERIOD);
+    total_start += now_ns() - t;
+    t = now_ns();
+    native_process_run();
+    total_plan += now_ns() - t;
+  }
+  *sf_start = (double)total_start / iterations;
+  *plan = (double)total_plan / iterations;
+}
+/*---------------------------------------------------------------------------*/
+static double
+bench_reschedule(void)
+{
+  linkaddr_t addr;
+  uint64_t t, total = 0;
+  int i;
+
+  native_linkaddr(&addr, CHILD_ID(0));
+  for(i = 0; i < iterations; i++) {
+    t = now_ns();
+    unicast_per_neighbor_rpl_storing.child_added(&addr, 1);
+    total += now_ns() - t;
+    native_process_run();
+  }
+  return (double)total / iterations;
+}
+/*---------------------------------------------------------------------------*/
+static double
+bench_packet_for_nbr(int n)
+{
+  struct tsch_slotframe *sf = tsch_schedule_get_slotframe_by_handle(ALICE_UNICAST_SF_ID);
+  struct tsch_neighbor *nbrs[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES];
+  struct tsch_link *link;
+  linkaddr_t addr;
+  uint64_t t, total = 0;
+  int i, j, num_nbrs = 0;
+
+  /* One packet per child, as many as the packet pool allows */
+  for(i = 0; i < n && i < QUEUEBUF_NUM; i++) {
+    native_linkaddr(&addr, CHILD_ID(i));
+    packetbuf_clear();
+    packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, FRAME802154_DATAFRAME);
+    packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &addr);
+    if(tsch_queue_add_packet(&addr, NULL, NULL) != NULL) {
+      nbrs[num_nbrs++] = tsch_queue_get_nbr(&addr);
+    }
+  }
+
+  for(link = list_head(sf->links_list); link != NULL; link = list_item_next(link)) {
+    if(link->link_options & LINK_OPTION_TX) {
+      break;
+    }
+  }
+  if(link == NULL || num_nbrs == 0) {
+    return 0;
+  }
+
+  for(i = 0; i < iterations; i++) {
+    t = now_ns();
+    for(j = 0; j < num_nbrs; j++) {
+      tsch_queue_get_packet_for_nbr(nbrs[j], link);
+    }
+    total += now_ns() - t;
+  }
+  return (double)total / iterations / num_nbrs;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  struct tsch_slotframe *sf;
+  double next_link, sf_start, plan, reschedule, pkt_for_nbr;
+  int max_children = MAX_NODE_NUM - 2;
+  int step = 4;
+  int n;
+
+  if(argc > 1) {
+    max_children = atoi(argv[1]);
+  }
+  if(argc > 2) {
+    step = atoi(argv[2]);
+  }
+  if(argc > 3) {
+    iterations = atoi(argv[3]);
+  }
+  if(max_children > NBR_TABLE_MAX_NEIGHBORS - 1) {
+    max_children = NBR_TABLE_MAX_NEIGHBORS - 1;
+  }
+  if(step < 1 || iterations < 1) {
+    fprintf(stderr, "usage: %s [max_children [step [iterations]]]\n", argv[0]);
+    return 1;
+  }
+
+  tsch_queue_init();
+  tsch_schedule_init();
+
+  printf("%8s %6s %10s %10s %10s %11s %11s\n", "children", "links",
+         "next_link", "sf_start", "plan", "reschedule", "pkt_for_nbr");
+  for(n = 1; n <= max_children; n = (n == 1 && step > 1) ? step : n + step) {
+    setup(n);
+    sf = tsch_schedule_get_slotframe_by_handle(ALICE_UNICAST_SF_ID);
+    next_link = bench_next_link();
+    bench_sf_start(&sf_start, &plan);
+    reschedule = bench_reschedule();
+    pkt_for_nbr = bench_packet_for_nbr(n);
+    printf("%8d %6d %10.1f %10.1f %10.1f %11.1f %11.1f\n", n,
+           sf != NULL ? list_length(sf->links_list) : 0,
+           next_link, sf_start, plan, reschedule, pkt_for_nbr);
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Host benchmark of the TSCH neighbor lookup, tsch_queue_get_nbr(), with
+ * the hash index or the list walk selected by TSCH_QUEUE_CONF_WITH_NBR_HASH.
+ * For each number of neighbors, reports ns/lookup of:
+ *   hit    a neighbor in the queue module, as on a Tx slot or an enqueue
+ *   miss   an address with no neighbor, as on a first enqueue or link add
+ *
+ * Usage: bench-nbr [--header] [num_neighbors...]
+ */
+
+#include "contiki.h"
+#include "native.h"
+#include "net/mac/tsch/tsch-queue.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#undef printf
+
+#define NEIGHBOR_ID(i) (0x100 + (i))
+#define MISS_ID(i)     (0x8000 + (i))
+
+void tsch_queue_init(void);
+
+static int iterations = 200;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static double
+bench_lookup(const linkaddr_t *addrs, int n)
+{
+  volatile uintptr_t sink = 0;
+  uint64_t t;
+  int i, j;
+
+  t = now_ns();
+  for(i = 0; i < iterations; i++) {
+    for(j = 0; j < n; j++) {
+      sink += (uintptr_t)tsch_queue_get_nbr(&addrs[j]);
+    }
+  }
+  (void)sink;
+  return (double)(now_ns() - t) / iterations / n;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  static const int default_sizes[] = { 10, 70, 250 };
+  static linkaddr_t hits[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES], misses[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES];
+  int num_sizes = argc > 1 ? argc - 1 : 3;
+  int s, i, n, added;
+
+  if(argc > 1 && strcmp(argv[1], "--header") == 0) {
+    printf("%-6s %10s %8s %8s\n", "lookup", "neighbors", "hit", "miss");
+    return 0;
+  }
+
+  tsch_queue_init();
+  for(s = 0; s < num_sizes; s++) {
+    n = argc > 1 ? atoi(argv[s + 1]) : default_sizes[s];
+    if(n < 1 || n > TSCH_QUEUE_MAX_NEIGHBOR_QUEUES - 2) {
+      fprintf(stderr, "usage: %s [--header] [num_neighbors (1..%d)...]\n",
+              argv[0], TSCH_QUEUE_MAX_NEIGHBOR_QUEUES - 2);
+      return 1;
+    }
+    /* Start over from the two virtual neighbors */
+    tsch_queue_free_unused_neighbors();
+    for(i = added = 0; i < n; i++) {
+      native_linkaddr(&hits[i], NEIGHBOR_ID(i));
+      native_linkaddr(&misses[i], MISS_ID(i));
+      added += tsch_queue_add_nbr(&hits[i]) != NULL;
+    }
+    if(added != n) {
+      fprintf(stderr, "only %d of %d neighbors added\n", added, n);
+      return 1;
+    }
+    printf("%-6s %10d %8.1f %8.1f\n", TSCH_QUEUE_WITH_NBR_HASH ? "hash" : "list", n,
+           bench_lookup(hits, n), bench_lookup(misses, n));
+  }
+  return 0;
+}
@@ -0,0 +1,808 @@
+/*
+ * Analyzer of the experiment logs. Memory-maps the logs, cuts them into
+ * chunks at line boundaries and parses the chunks on a pool of threads,
+ * with a tokenizer that scans the mapped bytes in place. Reports, as CSV:
+ *   nodes    per source of the root dumps, the "n: idx hi. lo re: received
+ *            delay [lost l min m max M]" rows of udp-server: received and
+ *            lost packets, PDR, mean and percentile delay in slots and ms
+ *   series   every dump row with its deltas since the previous dump of the
+ *            same source in the same file
+ *   clients  per client section of the logs, opened by a line holding only
+ *            the node id: "S:" reports, packets sent and replies received,
+ *            and the server to client delay of the "Client rxvc" lines;
+ *            the lines before the first section go to client 0
+ * A timestamp in front of a line, as the serial logger adds, is optional.
+ * A counter going down starts a new run: the deltas of all the runs and
+ * files add up. PDR comes from the lost column when the dumps have it,
+ * else from -e, the packets sent by every source. The root delay of a
+ * dump is a sum, so its percentiles are of the mean delay of each dump
+ * interval, weighted by the packets received in the interval.
+ *
+ * With -b the table is written in binary columnar form instead: "ALOG",
+ * uint32 version, rows and columns, 16-byte column names, then each column
+ * as rows doubles, all little-endian, NaN for a missing value.
+ *
+ * Usage: log-analyzer [-r nodes|series|clients] [-b] [-j threads]
+ *                     [-s slot_ms] [-e expected] [-o out_file] log_file...
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_FILES     65535
+#define MAX_IDS       65536 /* node addresses hi.lo, client node ids */
+#define CHUNK_MIN     (64 * 1024)
+#define CHUNK_MAX     (64 * 1024 * 1024)
+#define BIN_VERSION   1
+#define BIN_NAME_LEN  16
+#define NO_DELAY      300001 /* delay_SC of udp-client, not measured */
+
+enum { REC_SECTION, REC_DUMP, REC_REPORT, REC_RXVC };
+
+/* A parsed line. DUMP: node, received, delay, lost, min, max;
+ * REPORT: seq, reply, -, -, section; RXVC: delay, -, -, -, section;
+ * SECTION: node id */
+struct record {
+  double time;      /* NAN without a timestamp */
+  uint32_t v[6];
+  uint16_t file;
+  uint8_t type;
+  uint8_t has_lost; /* DUMP: lost, min and max were there */
+};
+
+struct chunk {
+  const char *begin, *end;
+  uint16_t file;
+  struct record *recs;
+  size_t num, size;
+};
+
+/* A line being tokenized */
+struct cursor {
+  const char *p, *end;
+};
+
+struct sample {
+  double value, weight;
+};
+
+struct samples {
+  struct sample *s;
+  size_t num, size;
+  double total;
+};
+
+struct node_acc {
+  uint16_t node;
+  int32_t last_file; /* -1 before the first dump */
+  uint32_t last_received, last_delay, last_lost;
+  uint32_t dumps;
+  int has_lost;
+  double received, delay, lost;
+  uint32_t min, max;
+  struct samples delays;
+};
+
+struct client_acc {
+  uint32_t id;
+  int32_t last_file;
+  uint32_t last_seq, last_reply;
+  uint32_t reports;
+  double sent, replies;
+  struct samples delays;
+};
+
+enum { COL_NUM, COL_NODE };
+
+struct table {
+  int cols;
+  const char *const *names;
+  const uint8_t *kinds;
+  double *cells;
+  size_t rows, size;
+};
+
+struct log_file {
+  const char *name;
+  const char *data;
+  size_t len;
+};
+
+static struct log_file files[MAX_FILES];
+static int num_files;
+static struct chunk *chunks;
+static int num_chunks;
+static int next_chunk;
+
+static double slot_ms = 10; /* TSCH default timeslot length */
+static double expected;     /* -e, 0 if not given */
+/*---------------------------------------------------------------------------*/
+static void *
+xrealloc(void *p, size_t size)
+{
+  p = realloc(p, size);
+  if(p == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+static void
+skip_blanks(struct cursor *c)
+{
+  while(c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r')) {
+    c->p++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_uint(struct cursor *c, uint32_t *v)
+{
+  uint32_t x = 0;
+
+  skip_blanks(c);
+  if(c->p == c->end || *c->p < '0' || *c->p > '9') {
+    return 0;
+  }
+  while(c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+    x = x * 10 + (*c->p++ - '0');
+  }
+  *v = x;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_hex(struct cursor *c, uint32_t *v)
+{
+  uint32_t x = 0;
+  int n = 0, d;
+
+  skip_blanks(c);
+  for(; c->p < c->end; c->p++, n++) {
+    if(*c->p >= '0' && *c->p <= '9') {
+      d = *c->p - '0';
+    } else if((*c->p | 0x20) >= 'a' && (*c->p | 0x20) <= 'f') {
+      d = (*c->p | 0x20) - 'a' + 10;
+    } else {
+      break;
+    }
+    x = x * 16 + d;
+  }
+  *v = x;
+  return n > 0;
+}
+/*---------------------------------------------------------------------------*/
+/* A decimal number with an optional fraction, as the logger timestamps */
+static int
+get_time(struct cursor *c, double *t)
+{
+  uint32_t i, f = 0;
+  double scale = 1;
+
+  if(!get_uint(c, &i)) {
+    return 0;
+  }
+  if(c->p < c->end && *c->p == '.') {
+    for(c->p++; c->p < c->end && *c->p >= '0' && *c->p <= '9'; c->p++) {
+      if(scale < 1e9) {
+        f = f * 10 + (*c->p - '0');
+        scale *= 10;
+      }
+    }
+  }
+  *t = i + f / scale;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Skips the literal w if it comes next */
+static int
+get_word(struct cursor *c, const char *w)
+{
+  size_t len = strlen(w);
+
+  skip_blanks(c);
+  if((size_t)(c->end - c->p) < len || memcmp(c->p, w, len) != 0) {
+    return 0;
+  }
+  c->p += len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Skips to the end of the first w in the rest of the line */
+static int
+find_word(struct cursor *c, const char *w)
+{
+  size_t len = strlen(w);
+  const char *p;
+
+  for(p = c->p; (size_t)(c->end - p) >= len; p++) {
+    if(*p == *w && memcmp(p, w, len) == 0) {
+      c->p = p + len;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+chunk_add(struct chunk *ch, const struct record *r)
+{
+  if(ch->num == ch->size) {
+    ch->size = ch->size ? 2 * ch->size : 1024;
+    ch->recs = xrealloc(ch->recs, ch->size * sizeof(*ch->recs));
+  }
+  ch->recs[ch->num++] = *r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_line(struct chunk *ch, const char *p, const char *end)
+{
+  struct cursor c = { p, end };
+  struct record r;
+  uint32_t v;
+
+  memset(&r, 0, sizeof(r));
+  r.time = NAN;
+  r.file = ch->file;
+
+  /* A number alone on its line opens a client section */
+  if(get_uint(&c, &v)) {
+    skip_blanks(&c);
+    if(c.p == c.end) {
+      r.type = REC_SECTION;
+      r.v[0] = v;
+      chunk_add(ch, &r);
+      return;
+    }
+    c.p = p;
+    get_time(&c, &r.time);
+  }
+
+  if(get_word(&c, "n:")) {
+    r.type = REC_DUMP;
+    if(get_uint(&c, &v) && get_hex(&c, &r.v[0]) && get_word(&c, ".")
+       && get_hex(&c, &v) && get_word(&c, "re:")
+       && get_uint(&c, &r.v[1]) && get_uint(&c, &r.v[2])) {
+      r.v[0] = (r.v[0] & 0xff) << 8 | (v & 0xff);
+      r.has_lost = get_word(&c, "lost") && get_uint(&c, &r.v[3])
+        && get_word(&c, "min") && get_uint(&c, &r.v[4])
+        && get_word(&c, "max") && get_uint(&c, &r.v[5]);
+      chunk_add(ch, &r);
+    }
+  } else if(get_word(&c, "S:")) {
+    r.type = REC_REPORT;
+    if(get_uint(&c, &r.v[0]) && get_uint(&c, &r.v[1])) {
+      chunk_add(ch, &r);
+    }
+  } else if(get_word(&c, "Client") && get_word(&c, "rxvc")) {
+    r.type = REC_RXVC;
+    if(find_word(&c, "delay:") && get_uint(&c, &r.v[0]) && r.v[0] != NO_DELAY) {
+      chunk_add(ch, &r);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void *
+parse_worker(void *arg)
+{
+  struct chunk *ch;
+  const char *p, *eol;
+  int i;
+
+  while((i = __sync_fetch_and_add(&next_chunk, 1)) < num_chunks) {
+    ch = &chunks[i];
+    for(p = ch->begin; p < ch->end; p = eol + 1) {
+      eol = memchr(p, '\n', ch->end - p);
+      if(eol == NULL) {
+        eol = ch->end;
+      }
+      parse_line(ch, p, eol);
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+map_file(struct log_file *f)
+{
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open(f->name, O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) < 0) {
+    perror(f->name);
+    if(fd >= 0) {
+      close(fd);
+    }
+    return 0;
+  }
+  f->len = st.st_size;
+  if(f->len > 0) {
+    data = mmap(NULL, f->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+      perror(f->name);
+      close(fd);
+      return 0;
+    }
+    madvise(data, f->len, MADV_SEQUENTIAL);
+    f->data = data;
+  }
+  close(fd);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Cuts the files into chunks of about chunk_len bytes, ending at newlines */
+static void
+make_chunks(size_t chunk_len)
+{
+  const char *p, *end, *cut;
+  int f, size = 0;
+
+  for(f = 0; f < num_files; f++) {
+    end = files[f].data + files[f].len;
+    for(p = files[f].data; p < end; p = cut) {
+      cut = (size_t)(end - p) > chunk_len ? p + chunk_len : end;
+      if(cut < end) {
+        cut = memchr(cut, '\n', end - cut);
+        cut = cut != NULL ? cut + 1 : end;
+      }
+      if(num_chunks == size) {
+        size = size ? 2 * size : 64;
+        chunks = xrealloc(chunks, size * sizeof(*chunks));
+      }
+      memset(&chunks[num_chunks], 0, sizeof(*chunks));
+      chunks[num_chunks].begin = p;
+      chunks[num_chunks].end = cut;
+      chunks[num_chunks].file = f;
+      num_chunks++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Client lines belong to the last section opened in the file, which may be
+ * in an earlier chunk */
+static void
+resolve_sections(void)
+{
+  uint32_t section = 0;
+  int i, file = -1;
+  size_t j;
+  struct record *r;
+
+  for(i = 0; i < num_chunks; i++) {
+    for(j = 0; j < chunks[i].num; j++) {
+      r = &chunks[i].recs[j];
+      if(r->file != file) {
+        file = r->file;
+        section = 0;
+      }
+      if(r->type == REC_SECTION) {
+        section = r->v[0];
+      } else if(r->type == REC_REPORT || r->type == REC_RXVC) {
+        r->v[4] = section;
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+samples_add(struct samples *s, double value, double weight)
+{
+  if(weight <= 0) {
+    return;
+  }
+  if(s->num == s->size) {
+    s->size = s->size ? 2 * s->size : 64;
+    s->s = xrealloc(s->s, s->size * sizeof(*s->s));
+  }
+  s->s[s->num].value = value;
+  s->s[s->num].weight = weight;
+  s->num++;
+  s->total += weight;
+}
+/*---------------------------------------------------------------------------*/
+static int
+sample_cmp(const void *a, const void *b)
+{
+  double x = ((const struct sample *)a)->value, y = ((const struct sample *)b)->value;
+  return x < y ? -1 : x > y;
+}
+/*---------------------------------------------------------------------------*/
+/* q-quantile of sorted samples, NAN if there are none */
+static double
+samples_quantile(const struct samples *s, double q)
+{
+  double sum = 0;
+  size_t i;
+
+  for(i = 0; i < s->num; i++) {
+    sum += s->s[i].weight;
+    if(sum >= q * s->total) {
+      return s->s[i].value;
+    }
+  }
+  return s->num > 0 ? s->s[s->num - 1].value : NAN;
+}
+/*---------------------------------------------------------------------------*/
+static void
+table_add(struct table *t, const double *row)
+{
+  if(t->rows == t->size) {
+    t->size = t->size ? 2 * t->size : 256;
+    t->cells = xrealloc(t->cells, t->size * t->cols * sizeof(double));
+  }
+  memcpy(&t->cells[t->rows * t->cols], row, t->cols * sizeof(double));
+  t->rows++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+table_write_csv(const struct table *t, FILE *out)
+{
+  const double *row;
+  size_t i;
+  int c;
+
+  for(c = 0; c < t->cols; c++) {
+    fprintf(out, "%s%c", t->names[c], c < t->cols - 1 ? ',' : '\n');
+  }
+  for(i = 0; i < t->rows; i++) {
+    row = &t->cells[i * t->cols];
+    for(c = 0; c < t->cols; c++) {
+      if(isnan(row[c])) {
+        /* Empty field */
+      } else if(t->kinds[c] == COL_NODE) {
+        fprintf(out, "%02x.%02x", (unsigned)row[c] >> 8, (unsigned)row[c] & 0xff);
+      } else {
+        fprintf(out, "%.10g", row[c]);
+      }
+      fputc(c < t->cols - 1 ? ',' : '\n', out);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_le(uint8_t *p, uint64_t v, int len)
+{
+  int i;
+
+  for(i = 0; i < len; i++) {
+    p[i] = v >> (8 * i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+table_write_bin(const struct table *t, FILE *out)
+{
+  uint8_t header[16], name[BIN_NAME_LEN], value[8];
+  uint64_t bits;
+  size_t i;
+  int c;
+
+  memcpy(header, "ALOG", 4);
+  put_le(header + 4, BIN_VERSION, 4);
+  put_le(header + 8, t->rows, 4);
+  put_le(header + 12, t->cols, 4);
+  fwrite(header, 1, sizeof(header), out);
+  for(c = 0; c < t->cols; c++) {
+    memset(name, 0, sizeof(name));
+    strncpy((char *)name, t->names[c], sizeof(name) - 1);
+    fwrite(name, 1, sizeof(name), out);
+  }
+  for(c = 0; c < t->cols; c++) {
+    for(i = 0; i < t->rows; i++) {
+      memcpy(&bits, &t->cells[i * t->cols + c], sizeof(bits));
+      put_le(value, bits, 8);
+      fwrite(value, 1, sizeof(value), out);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Packets and delay of a dump row since the previous dump of the node,
+ * d = { received, delay, lost }. Returns 1 if a new run starts with it */
+static int
+node_delta(struct node_acc *n, const struct record *r, double d[3])
+{
+  int restart = n->last_file != r->file
+    || r->v[1] < n->last_received || r->v[2] < n->last_delay
+    || r->v[3] < n->last_lost;
+
+  d[0] = restart ? r->v[1] : r->v[1] - n->last_received;
+  d[1] = restart ? r->v[2] : r->v[2] - n->last_delay;
+  d[2] = restart ? r->v[3] : r->v[3] - n->last_lost;
+  n->last_file = r->file;
+  n->last_received = r->v[1];
+  n->last_delay = r->v[2];
+  n->last_lost = r->v[3];
+  return restart;
+}
+/*---------------------------------------------------------------------------*/
+static struct node_acc *
+get_node(struct node_acc **nodes, int32_t *index, int *num, uint16_t node)
+{
+  struct node_acc *n;
+
+  if(index[node] < 0) {
+    index[node] = *num;
+    *nodes = xrealloc(*nodes, (*num + 1) * sizeof(**nodes));
+    n = &(*nodes)[(*num)++];
+    memset(n, 0, sizeof(*n));
+    n->node = node;
+    n->last_file = -1;
+    n->min = UINT32_MAX;
+  }
+  return &(*nodes)[index[node]];
+}
+/*---------------------------------------------------------------------------*/
+#define FOR_EACH_RECORD(r) \
+  for(ci = 0; ci < num_chunks; ci++) \
+    for(ri = 0, r = chunks[ci].recs; ri < chunks[ci].num; ri++, r++)
+
+static void
+report_nodes(struct table *t, int series)
+{
+  static const char *const series_names[] = {
+    "file", "time", "node", "received", "delay", "lost",
+    "d_received", "d_delay", "d_lost", "mean_slots", "mean_ms"
+  };
+  static const uint8_t series_kinds[] = {
+    COL_NUM, COL_NUM, COL_NODE, COL_NUM, COL_NUM, COL_NUM,
+    COL_NUM, COL_NUM, COL_NUM, COL_NUM, COL_NUM
+  };
+  static const char *const node_names[] = {
+    "node", "dumps", "received", "lost", "pdr", "mean_slots", "mean_ms",
+    "p50_slots", "p90_slots", "p99_slots", "p50_ms", "p90_ms", "p99_ms",
+    "min_slots", "max_slots"
+  };
+  static const uint8_t node_kinds[] = {
+    COL_NODE, COL_NUM, COL_NUM, COL_NUM, COL_NUM, COL_NUM, COL_NUM,
+    COL_NUM, COL_NUM, COL_NUM, COL_NUM, COL_NUM, COL_NUM,
+    COL_NUM, COL_NUM
+  };
+  static int32_t index[MAX_IDS];
+  struct node_acc *nodes = NULL, *n;
+  const struct record *r;
+  double d[3], mean, row[15], sent;
+  size_t ri;
+  int ci, i, num = 0;
+
+  t->cols = series ? 11 : 15;
+  t->names = series ? series_names : node_names;
+  t->kinds = series ? series_kinds : node_kinds;
+  memset(index, 0xff, sizeof(index));
+
+  FOR_EACH_RECORD(r) {
+    if(r->type != REC_DUMP) {
+      continue;
+    }
+    n = get_node(&nodes, index, &num, r->v[0]);
+    node_delta(n, r, d);
+    mean = d[0] > 0 ? d[1] / d[0] : NAN;
+    if(series) {
+      row[0] = r->file;
+      row[1] = r->time;
+      row[2] = r->v[0];
+      row[3] = r->v[1];
+      row[4] = r->v[2];
+      row[5] = r->has_lost ? r->v[3] : NAN;
+      row[6] = d[0];
+      row[7] = d[1];
+      row[8] = r->has_lost ? d[2] : NAN;
+      row[9] = mean;
+      row[10] = mean * slot_ms;
+      table_add(t, row);
+      continue;
+    }
+    n->dumps++;
+    n->received += d[0];
+    n->delay += d[1];
+    n->lost += d[2];
+    if(r->has_lost) {
+      n->has_lost = 1;
+      if(r->v[1] > 0 && r->v[4] < n->min) {
+        n->min = r->v[4];
+      }
+      if(r->v[5] > n->max) {
+        n->max = r->v[5];
+      }
+    }
+    samples_add(&n->delays, mean, d[0]);
+  }
+
+  for(i = 0; !series && i < num; i++) {
+    n = &nodes[i];
+    qsort(n->delays.s, n->delays.num, sizeof(*n->delays.s), sample_cmp);
+    mean = n->received > 0 ? n->delay / n->received : NAN;
+    sent = n->has_lost ? n->received + n->lost : expected;
+    row[0] = n->node;
+    row[1] = n->dumps;
+    row[2] = n->received;
+    row[3] = n->has_lost ? n->lost : NAN;
+    row[4] = sent > 0 ? n->received / sent : NAN;
+    row[5] = mean;
+    row[6] = mean * slot_ms;
+    row[7] = samples_quantile(&n->delays, 0.5);
+    row[8] = samples_quantile(&n->delays, 0.9);
+    row[9] = samples_quantile(&n->delays, 0.99);
+    row[10] = row[7] * slot_ms;
+    row[11] = row[8] * slot_ms;
+    row[12] = row[9] * slot_ms;
+    row[13] = n->has_lost && n->min != UINT32_MAX ? n->min : NAN;
+    row[14] = n->has_lost ? n->max : NAN;
+    table_add(t, row);
+    free(n->delays.s);
+  }
+  free(nodes);
+}
+/*---------------------------------------------------------------------------*/
+static void
+report_clients(struct table *t)
+{
+  static const char *const names[] = {
+    "client", "reports", "sent", "replies", "reply_ratio", "rx", "mean_slots",
+    "mean_ms", "p50_slots", "p90_slots", "p99_slots", "p50_ms", "p90_ms",
+    "p99_ms"
+  };
+  static const uint8_t kinds[14] = { COL_NUM };
+  static int32_t index[MAX_IDS];
+  struct client_acc *clients = NULL, *cl;
+  const struct record *r;
+  double row[14], sum;
+  size_t ri, j;
+  int ci, i, num = 0, restart;
+
+  t->cols = 14;
+  t->names = names;
+  t->kinds = kinds;
+  memset(index, 0xff, sizeof(index));
+
+  FOR_EACH_RECORD(r) {
+    if((r->type != REC_REPORT && r->type != REC_RXVC) || r->v[4] >= MAX_IDS) {
+      continue;
+    }
+    if(index[r->v[4]] < 0) {
+      index[r->v[4]] = num;
+      clients = xrealloc(clients, (num + 1) * sizeof(*clients));
+      cl = &clients[num++];
+      memset(cl, 0, sizeof(*cl));
+      cl->id = r->v[4];
+      cl->last_file = -1;
+    }
+    cl = &clients[index[r->v[4]]];
+    if(r->type == REC_RXVC) {
+      samples_add(&cl->delays, r->v[0], 1);
+      continue;
+    }
+    restart = cl->last_file != r->file || r->v[0] < cl->last_seq
+      || r->v[1] < cl->last_reply;
+    cl->sent += restart ? r->v[0] : r->v[0] - cl->last_seq;
+    cl->replies += restart ? r->v[1] : r->v[1] - cl->last_reply;
+    cl->last_file = r->file;
+    cl->last_seq = r->v[0];
+    cl->last_reply = r->v[1];
+    cl->reports++;
+  }
+
+  for(i = 0; i < num; i++) {
+    cl = &clients[i];
+    qsort(cl->delays.s, cl->delays.num, sizeof(*cl->delays.s), sample_cmp);
+    for(j = 0, sum = 0; j < cl->delays.num; j++) {
+      sum += cl->delays.s[j].value;
+    }
+    row[0] = cl->id;
+    row[1] = cl->reports;
+    row[2] = cl->sent;
+    row[3] = cl->replies;
+    row[4] = cl->sent > 0 ? cl->replies / cl->sent : NAN;
+    row[5] = cl->delays.num;
+    row[6] = cl->delays.num > 0 ? sum / cl->delays.num : NAN;
+    row[7] = row[6] * slot_ms;
+    row[8] = samples_quantile(&cl->delays, 0.5);
+    row[9] = samples_quantile(&cl->delays, 0.9);
+    row[10] = samples_quantile(&cl->delays, 0.99);
+    row[11] = row[8] * slot_ms;
+    row[12] = row[9] * slot_ms;
+    row[13] = row[10] * slot_ms;
+    table_add(t, row);
+    free(cl->delays.s);
+  }
+  free(clients);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  const char *report = "nodes", *out_name = NULL;
+  struct table table;
+  pthread_t *threads;
+  size_t total = 0, chunk_len;
+  int opt, i, num_threads = sysconf(_SC_NPROCESSORS_ONLN), binary = 0;
+  FILE *out = stdout;
+
+  while((opt = getopt(argc, argv, "r:bj:s:e:o:")) != -1) {
+    switch(opt) {
+    case 'r': report = optarg; break;
+    case 'b': binary = 1; break;
+    case 'j': num_threads = atoi(optarg); break;
+    case 's': slot_ms = atof(optarg); break;
+    case 'e': expected = atof(optarg); break;
+    case 'o': out_name = optarg; break;
+    default: goto usage;
+    }
+  }
+  if(optind == argc || argc - optind > MAX_FILES || num_threads < 1 || slot_ms <= 0
+     || (strcmp(report, "nodes") && strcmp(report, "series") && strcmp(report, "clients"))) {
+    goto usage;
+  }
+
+  for(i = optind; i < argc; i++) {
+    files[num_files].name = argv[i];
+    if(!map_file(&files[num_files])) {
+      return 1;
+    }
+    total += files[num_files++].len;
+  }
+
+  /* A few chunks per thread, to even out the load */
+  chunk_len = total / (4 * num_threads);
+  chunk_len = chunk_len < CHUNK_MIN ? CHUNK_MIN : chunk_len > CHUNK_MAX ? CHUNK_MAX : chunk_len;
+  make_chunks(chunk_len);
+  if(num_threads > num_chunks) {
+    num_threads = num_chunks > 0 ? num_chunks : 1;
+  }
+  threads = xrealloc(NULL, num_threads * sizeof(*threads));
+  for(i = 0; i < num_threads; i++) {
+    pthread_create(&threads[i], NULL, parse_worker, NULL);
+  }
+  for(i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  resolve_sections();
+
+  memset(&table, 0, sizeof(table));
+  if(strcmp(report, "clients") == 0) {
+    report_clients(&table);
+  } else {
+    report_nodes(&table, strcmp(report, "series") == 0);
+  }
+
+  if(out_name != NULL && (out = fopen(out_name, binary ? "wb" : "w")) == NULL) {
+    perror(out_name);
+    return 1;
+  }
+  if(binary) {
+    table_write_bin(&table, out);
+  } else {
+    table_write_csv(&table, out);
+  }
+  if(out != stdout) {
+    fclose(out);
+  }
+
+  free(table.cells);
+  for(i = 0; i < num_chunks; i++) {
+    free(chunks[i].recs);
+  }
+  free(chunks);
+  for(i = 0; i < num_files; i++) {
+    if(files[i].len > 0) {
+      munmap((void *)files[i].data, files[i].len);
+    }
+  }
+  return 0;
+
+usage:
+  fprintf(stderr, "usage: %s [-r nodes|series|clients] [-b] [-j threads] [-s slot_ms] "
+          "[-e expected] [-o out_file] log_file...\n", argv[0]);
+  return 1;
+}
@@ -0,0 +1,20 @@
+#ifndef CONTIKI_CONF_H_
+#define CONTIKI_CONF_H_
+
+#ifdef PROJECT_CONF_H
+#include PROJECT_CONF_H
+#endif
+
+#ifndef NBR_TABLE_CONF_MAX_NEIGHBORS
+#define NBR_TABLE_CONF_MAX_NEIGHBORS 8
+#endif
+
+#ifndef QUEUEBUF_CONF_NUM
+#define QUEUEBUF_CONF_NUM 8
+#endif
+
+#ifndef LINKADDR_CONF_SIZE
+#define LINKADDR_CONF_SIZE 8
+#endif
+
+#endif /* CONTIKI_CONF_H_ */
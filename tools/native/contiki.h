@@ -0,0 +1,37 @@
+/*
+ * Native (Linux) stand-in for the Contiki headers used by the TSCH and
+ * ATRIA sources of this tree. Only what tools/ needs to compile and run
+ * tsch-schedule.c, tsch-queue.c and the ATRIA rule on a host.
+ */
+
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+
+#include "contiki-conf.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sys/process.h"
+#include "sys/clock.h"
+#include "sys/rtimer.h"
+#include "lib/list.h"
+#include "net/linkaddr.h"
+
+#ifndef MIN
+#define MIN(n, m)   (((n) < (m)) ? (n) : (m))
+#endif
+
+#ifndef MAX
+#define MAX(n, m)   (((n) < (m)) ? (m) : (n))
+#endif
+
+/* Route the console output of the sources under test through a switch,
+ * so that benchmarks are not dominated by printf */
+extern int native_verbose;
+int native_printf(const char *fmt, ...);
+#define printf(...) native_printf(__VA_ARGS__)
+
+#endif /* CONTIKI_H_ */
@@ -0,0 +1,8 @@
+#ifndef LEDS_H_
+#define LEDS_H_
+
+#define leds_on(l)
+#define leds_off(l)
+#define leds_toggle(l)
+
+#endif /* LEDS_H_ */
@@ -0,0 +1,22 @@
+#ifndef RINGBUFINDEX_H_
+#define RINGBUFINDEX_H_
+
+#include <stdint.h>
+
+struct ringbufindex {
+  uint8_t mask;
+  /* These must be 8-bit quantities to avoid race conditions. */
+  uint8_t put_ptr, get_ptr;
+};
+
+void ringbufindex_init(struct ringbufindex *r, uint8_t size);
+int ringbufindex_put(struct ringbufindex *r);
+int ringbufindex_peek_put(const struct ringbufindex *r);
+int ringbufindex_get(struct ringbufindex *r);
+int ringbufindex_peek_get(const struct ringbufindex *r);
+int ringbufindex_size(const struct ringbufindex *r);
+int ringbufindex_elements(const struct ringbufindex *r);
+int ringbufindex_full(const struct ringbufindex *r);
+int ringbufindex_empty(const struct ringbufindex *r);
+
+#endif /* RINGBUFINDEX_H_ */
@@ -0,0 +1,652 @@
+/*
+ * Host implementations of the Contiki primitives declared under
+ * tools/native: lists, memory blocks, ring buffer indices, neighbor
+ * tables, packetbuf/queuebuf, processes, and the few TSCH, RPL and
+ * Orchestra globals the sources under test expect to find.
+ */
+
+#include "contiki.h"
+#include "lib/memb.h"
+#include "lib/random.h"
+#include "lib/ringbufindex.h"
+#include "net/nbr-table.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/mac/mac.h"
+#include "net/mac/tsch/tsch-private.h"
+#include "net/mac/tsch/tsch-queue.h"
+#include "net/mac/tsch/tsch-slot-operation.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/rpl/rpl.h"
+#include "orchestra.h"
+#include "native.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+#undef printf
+
+int native_verbose;
+/*---------------------------------------------------------------------------*/
+int
+native_printf(const char *fmt, ...)
+{
+  va_list ap;
+  int ret = 0;
+  if(native_verbose) {
+    va_start(ap, fmt);
+    ret = vprintf(fmt, ap);
+    va_end(ap);
+  }
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+/* lib/list.c */
+struct list {
+  struct list *next;
+};
+void
+list_init(list_t list)
+{
+  *list = NULL;
+}
+void *
+list_head(list_t list)
+{
+  return *list;
+}
+void *
+list_tail(list_t list)
+{
+  struct list *l;
+  if(*list == NULL) {
+    return NULL;
+  }
+  for(l = *list; l->next != NULL; l = l->next);
+  return l;
+}
+void
+list_add(list_t list, void *item)
+{
+  struct list *l;
+  list_remove(list, item);
+  ((struct list *)item)->next = NULL;
+  l = list_tail(list);
+  if(l == NULL) {
+    *list = item;
+  } else {
+    l->next = item;
+  }
+}
+void
+list_push(list_t list, void *item)
+{
+  list_remove(list, item);
+  ((struct list *)item)->next = *list;
+  *list = item;
+}
+void *
+list_chop(list_t list)
+{
+  struct list *l, *r;
+  if(*list == NULL) {
+    return NULL;
+  }
+  if(((struct list *)*list)->next == NULL) {
+    l = *list;
+    *list = NULL;
+    return l;
+  }
+  for(l = *list; l->next->next != NULL; l = l->next);
+  r = l->next;
+  l->next = NULL;
+  return r;
+}
+void *
+list_pop(list_t list)
+{
+  struct list *l = *list;
+  if(*list != NULL) {
+    *list = ((struct list *)*list)->next;
+  }
+  return l;
+}
+void
+list_remove(list_t list, void *item)
+{
+  struct list *l, *r = NULL;
+  for(l = *list; l != NULL; l = l->next) {
+    if(l == item) {
+      if(r == NULL) {
+        *list = l->next;
+      } else {
+        r->next = l->next;
+      }
+      l->next = NULL;
+      return;
+    }
+    r = l;
+  }
+}
+int
+list_length(list_t list)
+{
+  struct list *l;
+  int n = 0;
+  for(l = *list; l != NULL; l = l->next) {
+    ++n;
+  }
+  return n;
+}
+void
+list_insert(list_t list, void *previtem, void *newitem)
+{
+  if(previtem == NULL) {
+    list_push(list, newitem);
+  } else {
+    ((struct list *)newitem)->next = ((struct list *)previtem)->next;
+    ((struct list *)previtem)->next = newitem;
+  }
+}
+void *
+list_item_next(void *item)
+{
+  return item == NULL ? NULL : ((struct list *)item)->next;
+}
+/*---------------------------------------------------------------------------*/
+/* lib/memb.c */
+void
+memb_init(struct memb *m)
+{
+  memset(m->count, 0, m->num);
+  memset(m->mem, 0, (size_t)m->size * m->num);
+}
+void *
+memb_alloc(struct memb *m)
+{
+  int i;
+  for(i = 0; i < m->num; ++i) {
+    if(m->count[i] == 0) {
+      ++(m->count[i]);
+      return (void *)((char *)m->mem + (i * m->size));
+    }
+  }
+  return NULL;
+}
+char
+memb_free(struct memb *m, void *ptr)
+{
+  int i;
+  char *ptr2 = (char *)m->mem;
+  for(i = 0; i < m->num; ++i) {
+    if(ptr2 == (char *)ptr) {
+      if(m->count[i] > 0) {
+        --(m->count[i]);
+      }
+      return m->count[i];
+    }
+    ptr2 += m->size;
+  }
+  return -1;
+}
+int
+memb_inmemb(struct memb *m, void *ptr)
+{
+  return (char *)ptr >= (char *)m->mem &&
+         (char *)ptr < (char *)m->mem + (m->num * m->size);
+}
+int
+memb_numfree(struct memb *m)
+{
+  int i, num_free = 0;
+  for(i = 0; i < m->num; ++i) {
+    if(m->count[i] == 0) {
+      ++num_free;
+    }
+  }
+  return num_free;
+}
+/*---------------------------------------------------------------------------*/
+/* lib/ringbufindex.c */
+void
+ringbufindex_init(struct ringbufindex *r, uint8_t size)
+{
+  r->mask = size - 1;
+  r->put_ptr = 0;
+  r->get_ptr = 0;
+}
+int
+ringbufindex_put(struct ringbufindex *r)
+{
+  if(((r->put_ptr - r->get_ptr) & r->mask) == r->mask) {
+    return 0;
+  }
+  r->put_ptr = (r->put_ptr + 1) & r->mask;
+  return 1;
+}
+int
+ringbufindex_peek_put(const struct ringbufindex *r)
+{
+  if(((r->put_ptr - r->get_ptr) & r->mask) == r->mask) {
+    return -1;
+  }
+  return r->put_ptr;
+}
+int
+ringbufindex_get(struct ringbufindex *r)
+{
+  uint8_t get_ptr;
+  if(((r->put_ptr - r->get_ptr) & r->mask) > 0) {
+    get_ptr = r->get_ptr;
+    r->get_ptr = (r->get_ptr + 1) & r->mask;
+    return get_ptr;
+  }
+  return -1;
+}
+int
+ringbufindex_peek_get(const struct ringbufindex *r)
+{
+  if(((r->put_ptr - r->get_ptr) & r->mask) > 0) {
+    return r->get_ptr;
+  }
+  return -1;
+}
+int
+ringbufindex_size(const struct ringbufindex *r)
+{
+  return r->mask + 1;
+}
+int
+ringbufindex_elements(const struct ringbufindex *r)
+{
+  return (r->put_ptr - r->get_ptr) & r->mask;
+}
+int
+ringbufindex_full(const struct ringbufindex *r)
+{
+  return ((r->put_ptr - r->get_ptr) & r->mask) == r->mask;
+}
+int
+ringbufindex_empty(const struct ringbufindex *r)
+{
+  return ringbufindex_elements(r) == 0;
+}
+/*---------------------------------------------------------------------------*/
+/* lib/random.c */
+static unsigned long random_state = 1;
+unsigned short
+random_rand(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (unsigned short)(random_state >> 16);
+}
+void
+random_init(unsigned short seed)
+{
+  random_state = seed;
+}
+/*---------------------------------------------------------------------------*/
+/* net/linkaddr.c */
+linkaddr_t linkaddr_node_addr;
+const linkaddr_t linkaddr_null;
+void
+linkaddr_copy(linkaddr_t *dest, const linkaddr_t *src)
+{
+  memcpy(dest, src, LINKADDR_SIZE);
+}
+int
+linkaddr_cmp(const linkaddr_t *addr1, const linkaddr_t *addr2)
+{
+  return memcmp(addr1, addr2, LINKADDR_SIZE) == 0;
+}
+void
+linkaddr_set_node_addr(linkaddr_t *t)
+{
+  linkaddr_copy(&linkaddr_node_addr, t);
+}
+/*---------------------------------------------------------------------------*/
+/* net/nbr-table.c, with one key set per table */
+static void *
+item_from_index(nbr_table_t *table, int index)
+{
+  return index >= 0 ? (char *)table->data + index * table->item_size : NULL;
+}
+static int
+index_from_item(nbr_table_t *table, const nbr_table_item_t *item)
+{
+  return item != NULL ? (int)(((const char *)item - (char *)table->data) / table->item_size) : -1;
+}
+static int
+index_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
+{
+  int i;
+  for(i = 0; i < NBR_TABLE_MAX_NEIGHBORS; i++) {
+    if(table->used[i] && linkaddr_cmp(&table->keys[i], lladdr)) {
+      return i;
+    }
+  }
+  return -1;
+}
+nbr_table_item_t *
+nbr_table_head(nbr_table_t *table)
+{
+  int i;
+  for(i = 0; i < NBR_TABLE_MAX_NEIGHBORS; i++) {
+    if(table->used[i]) {
+      return item_from_index(table, i);
+    }
+  }
+  return NULL;
+}
+nbr_table_item_t *
+nbr_table_next(nbr_table_t *table, nbr_table_item_t *item)
+{
+  int i;
+  for(i = index_from_item(table, item) + 1; i < NBR_TABLE_MAX_NEIGHBORS; i++) {
+    if(table->used[i]) {
+      return item_from_index(table, i);
+    }
+  }
+  return NULL;
+}
+nbr_table_item_t *
+nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr,
+                     nbr_table_reason_t reason, void *data)
+{
+  int i = index_from_lladdr(table, lladdr);
+  if(i < 0) {
+    for(i = 0; i < NBR_TABLE_MAX_NEIGHBORS && table->used[i]; i++);
+    if(i == NBR_TABLE_MAX_NEIGHBORS) {
+      return NULL;
+    }
+    table->used[i] = 1;
+    linkaddr_copy(&table->keys[i], lladdr);
+    memset(item_from_index(table, i), 0, table->item_size);
+  }
+  return item_from_index(table, i);
+}
+nbr_table_item_t *
+nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
+{
+  return item_from_index(table, index_from_lladdr(table, lladdr));
+}
+int
+nbr_table_remove(nbr_table_t *table, nbr_table_item_t *item)
+{
+  int i = index_from_item(table, item);
+  if(i >= 0) {
+    table->used[i] = 0;
+    return 1;
+  }
+  return 0;
+}
+linkaddr_t *
+nbr_table_get_lladdr(nbr_table_t *table, const nbr_table_item_t *item)
+{
+  int i = index_from_item(table, item);
+  return i >= 0 ? &table->keys[i] : NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* net/packetbuf.c and net/queuebuf.c: attributes and addresses only */
+struct queuebuf {
+  packetbuf_attr_t attrs[PACKETBUF_ATTR_MAX];
+  linkaddr_t addrs[PACKETBUF_NUM_ADDRS];
+};
+static struct queuebuf packetbuf_meta;
+MEMB(queuebuf_memb, struct queuebuf, QUEUEBUF_NUM);
+static int queuebuf_initialized;
+
+void
+packetbuf_clear(void)
+{
+  memset(&packetbuf_meta, 0, sizeof(packetbuf_meta));
+}
+int
+packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
+{
+  packetbuf_meta.attrs[type] = val;
+  return 1;
+}
+packetbuf_attr_t
+packetbuf_attr(uint8_t type)
+{
+  return packetbuf_meta.attrs[type];
+}
+int
+packetbuf_set_addr(uint8_t type, const linkaddr_t *addr)
+{
+  linkaddr_copy(&packetbuf_meta.addrs[type - PACKETBUF_ADDR_FIRST], addr);
+  return 1;
+}
+const linkaddr_t *
+packetbuf_addr(uint8_t type)
+{
+  return &packetbuf_meta.addrs[type - PACKETBUF_ADDR_FIRST];
+}
+struct queuebuf *
+queuebuf_new_from_packetbuf(void)
+{
+  struct queuebuf *b;
+  if(!queuebuf_initialized) {
+    memb_init(&queuebuf_memb);
+    queuebuf_initialized = 1;
+  }
+  b = memb_alloc(&queuebuf_memb);
+  if(b != NULL) {
+    *b = packetbuf_meta;
+  }
+  return b;
+}
+void
+queuebuf_free(struct queuebuf *b)
+{
+  memb_free(&queuebuf_memb, b);
+}
+packetbuf_attr_t
+queuebuf_attr(struct queuebuf *b, uint8_t type)
+{
+  return b->attrs[type];
+}
+linkaddr_t *
+queuebuf_addr(struct queuebuf *b, uint8_t type)
+{
+  return &b->addrs[type - PACKETBUF_ADDR_FIRST];
+}
+/*---------------------------------------------------------------------------*/
+/* net/mac/mac.c */
+void
+mac_call_sent_callback(mac_callback_t sent, void *ptr, int status, int num_tx)
+{
+  if(sent != NULL) {
+    sent(ptr, status, num_tx);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* sys/process.c: a run queue of polled processes */
+static struct process *process_list;
+
+void
+process_start(struct process *p, process_data_t data)
+{
+  struct process *q;
+  for(q = process_list; q != NULL; q = q->next) {
+    if(q == p) {
+      return;
+    }
+  }
+  p->next = process_list;
+  process_list = p;
+  p->pt.lc = 0;
+  p->running = 1;
+  p->needspoll = 0;
+  p->thread(&p->pt, PROCESS_EVENT_INIT, data);
+}
+void
+process_poll(struct process *p)
+{
+  if(p != NULL && p->running) {
+    p->needspoll = 1;
+  }
+}
+/* TSCH: the dequeued packets, as tsch_tx_process_pending() handles them */
+struct ringbufindex dequeued_ringbuf = { TSCH_DEQUEUED_ARRAY_SIZE - 1, 0, 0 };
+struct tsch_packet *dequeued_array[TSCH_DEQUEUED_ARRAY_SIZE];
+struct process tsch_pending_events_process;
+
+static void
+tsch_tx_process_pending(void)
+{
+  int16_t dequeued_index;
+  while((dequeued_index = ringbufindex_peek_get(&dequeued_ringbuf)) != -1) {
+    struct tsch_packet *p = dequeued_array[dequeued_index];
+    mac_call_sent_callback(p->sent, p->ptr, p->ret, p->transmissions);
+    tsch_queue_free_packet(p);
+    ringbufindex_get(&dequeued_ringbuf);
+  }
+}
+int
+native_process_run(void)
+{
+  struct process *p;
+  int n = 0;
+  tsch_tx_process_pending();
+  for(p = process_list; p != NULL; p = p->next) {
+    if(p->needspoll) {
+      p->needspoll = 0;
+      p->thread(&p->pt, PROCESS_EVENT_POLL, NULL);
+      n++;
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/* TSCH: lock and globals normally provided by tsch.c and tsch-slot-operation.c */
+const linkaddr_t tsch_broadcast_address = { { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff } };
+const linkaddr_t tsch_eb_address = { { 0, 0, 0, 0, 0, 0, 0, 0 } };
+struct asn_t current_asn;
+uint8_t tsch_join_priority;
+struct tsch_link *current_link;
+int tsch_is_coordinator;
+int tsch_is_associated;
+
+int tsch_queue_overflow;
+volatile uint8_t tsch_slot_overloaded;
+uint16_t num_pktdrop_queue;
+uint16_t num_pktdrop_mac;
+
+static volatile int tsch_locked;
+
+int
+tsch_is_locked(void)
+{
+  return tsch_locked;
+}
+int
+tsch_get_lock(void)
+{
+  if(!tsch_locked) {
+    tsch_locked = 1;
+    return 1;
+  }
+  return 0;
+}
+void
+tsch_release_lock(void)
+{
+  tsch_locked = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Orchestra state and callbacks normally provided by orchestra.c,
+ * with the ATRIA unicast rule as the only rule */
+linkaddr_t orchestra_parent_linkaddr;
+int orchestra_parent_knows_us;
+static uint16_t default_slotframe = 9;
+static uint16_t default_timeslot = 0xffff;
+static uint16_t default_channel_offset;
+
+void
+native_set_default_cell(uint16_t slotframe, uint16_t timeslot, uint16_t channel_offset)
+{
+  default_slotframe = slotframe;
+  default_timeslot = timeslot;
+  default_channel_offset = channel_offset;
+}
+void
+orchestra_callback_packet_ready(void)
+{
+  uint16_t slotframe = default_slotframe;
+  uint16_t timeslot = default_timeslot;
+  uint16_t channel_offset = default_channel_offset;
+
+  unicast_per_neighbor_rpl_storing.select_packet(&slotframe, &timeslot, &channel_offset);
+
+  packetbuf_set_attr(PACKETBUF_ATTR_TSCH_SLOTFRAME, slotframe);
+  packetbuf_set_attr(PACKETBUF_ATTR_TSCH_TIMESLOT, timeslot);
+  packetbuf_set_attr(PACKETBUF_ATTR_TSCH_CHANNEL_OFFSET, channel_offset);
+}
+void
+orchestra_callback_new_time_source(const struct tsch_neighbor *old, const struct tsch_neighbor *new)
+{
+  if(new != old) {
+    orchestra_parent_knows_us = 0;
+  }
+  unicast_per_neighbor_rpl_storing.new_time_source(old, new);
+}
+/*---------------------------------------------------------------------------*/
+/* RPL and the route table: a root-less DAG and a configurable set of
+ * next hops, each with a given number of routes */
+static rpl_dag_t native_dag;
+static rpl_instance_t native_instance = { &native_dag, 256 };
+
+NBR_TABLE_GLOBAL(struct uip_ds6_route_neighbor_routes, nbr_routes);
+static struct uip_ds6_route_neighbor_route route_pool[NATIVE_MAX_ROUTES];
+static int num_routes;
+
+rpl_instance_t *
+rpl_get_default_instance(void)
+{
+  return &native_instance;
+}
+int
+uip_ds6_route_num_routes(void)
+{
+  return num_routes;
+}
+void
+native_set_rank(uint16_t rank)
+{
+  native_dag.rank = rank;
+}
+void
+native_routes_clear(void)
+{
+  nbr_table_item_t *item;
+  while((item = nbr_table_head(nbr_routes)) != NULL) {
+    nbr_table_remove(nbr_routes, item);
+  }
+  num_routes = 0;
+}
+int
+native_routes_add(const linkaddr_t *nexthop, int count)
+{
+  struct uip_ds6_route_neighbor_routes *routes;
+  routes = nbr_table_add_lladdr(nbr_routes, nexthop, NBR_TABLE_REASON_ROUTE, NULL);
+  if(routes == NULL) {
+    return 0;
+  }
+  if(routes->route_list == NULL) {
+    LIST_STRUCT_INIT(routes, route_list);
+  }
+  while(count-- > 0 && num_routes < NATIVE_MAX_ROUTES) {
+    list_add(routes->route_list, &route_pool[num_routes++]);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+native_linkaddr(linkaddr_t *addr, uint16_t id)
+{
+  memset(addr, 0, sizeof(linkaddr_t));
+  addr->u8[LINKADDR_SIZE - 2] = id >> 8;
+  addr->u8[LINKADDR_SIZE - 1] = id & 0xff;
+}
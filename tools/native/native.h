@@ -0,0 +1,28 @@
+/*
+ * Helpers exported by native.c to the host tools: control over the
+ * simulated RPL state (rank, next hops and their routes).
+ */
+
+#ifndef NATIVE_H_
+#define NATIVE_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+#ifndef NATIVE_MAX_ROUTES
+#define NATIVE_MAX_ROUTES 512
+#endif
+
+/* Sets the rank of our node, the root has rank min_hoprankinc (256) */
+void native_set_rank(uint16_t rank);
+/* Removes every next hop from nbr_routes */
+void native_routes_clear(void);
+/* Adds a next hop with count routes through it. Returns 0 if full. */
+int native_routes_add(const linkaddr_t *nexthop, int count);
+/* Builds a link-layer address from a 16-bit node id */
+void native_linkaddr(linkaddr_t *addr, uint16_t id);
+/* Sets the cell of the frames the ATRIA rule leaves to the other rules:
+ * slotframe 9, any timeslot (0xffff) and channel offset 0 by default */
+void native_set_default_cell(uint16_t slotframe, uint16_t timeslot, uint16_t channel_offset);
+
+#endif /* NATIVE_H_ */
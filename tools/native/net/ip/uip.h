@@ -0,0 +1,7 @@
+#ifndef UIP_H_
+#define UIP_H_
+
+#define UIP_PROTO_ICMP6 58
+#define UIP_PROTO_UDP   17
+
+#endif /* UIP_H_ */
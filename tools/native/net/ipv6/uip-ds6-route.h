@@ -0,0 +1,24 @@
+#ifndef UIP_DS6_ROUTE_H
+#define UIP_DS6_ROUTE_H
+
+#include "contiki.h"
+#include "net/nbr-table.h"
+#include "lib/list.h"
+
+NBR_TABLE_DECLARE(nbr_routes);
+
+struct uip_ds6_route;
+
+/* A neighbor that is the next hop of routes, and the list of those routes */
+struct uip_ds6_route_neighbor_routes {
+  LIST_STRUCT(route_list);
+};
+
+struct uip_ds6_route_neighbor_route {
+  struct uip_ds6_route_neighbor_route *next;
+  struct uip_ds6_route *route;
+};
+
+int uip_ds6_route_num_routes(void);
+
+#endif /* UIP_DS6_ROUTE_H */
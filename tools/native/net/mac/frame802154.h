@@ -0,0 +1,9 @@
+#ifndef FRAME_802154_H
+#define FRAME_802154_H
+
+#define FRAME802154_BEACONFRAME     (0x00)
+#define FRAME802154_DATAFRAME       (0x01)
+#define FRAME802154_ACKFRAME        (0x02)
+#define FRAME802154_CMDFRAME        (0x03)
+
+#endif /* FRAME_802154_H */
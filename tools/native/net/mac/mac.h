@@ -0,0 +1,23 @@
+#ifndef MAC_H_
+#define MAC_H_
+
+#include "contiki.h"
+
+typedef void (* mac_callback_t)(void *ptr, int status, int transmissions);
+
+enum {
+  MAC_TX_OK,
+  MAC_TX_COLLISION,
+  MAC_TX_NOACK,
+  MAC_TX_DEFERRED,
+  MAC_TX_ERR,
+  MAC_TX_ERR_FATAL,
+};
+
+void mac_call_sent_callback(mac_callback_t sent, void *ptr, int status, int num_tx);
+
+struct mac_driver {
+  char *name;
+};
+
+#endif /* MAC_H_ */
@@ -0,0 +1,6 @@
+#ifndef RDC_H_
+#define RDC_H_
+
+#include "net/mac/mac.h"
+
+#endif /* RDC_H_ */
@@ -0,0 +1,60 @@
+#ifndef __TSCH_ASN_H__
+#define __TSCH_ASN_H__
+
+#include <stdint.h>
+
+/* The ASN is an absolute slot number over 5 bytes. */
+struct asn_t {
+  uint32_t ls4b; /* least significant 4 bytes */
+  uint8_t  ms1b; /* most significant 1 byte */
+};
+
+/* For quick modulo operation on ASN */
+struct asn_divisor_t {
+  uint16_t val; /* Divisor value */
+  uint16_t asn_ms1b_remainder; /* Remainder of the operation 0x100000000 / val */
+};
+
+#define ASN_INIT(asn, ms1b_, ls4b_) do { \
+    (asn).ms1b = (ms1b_); \
+    (asn).ls4b = (ls4b_); \
+} while(0);
+
+#define ASN_INC(asn, inc) do { \
+    uint32_t new_ls4b = (asn).ls4b + (inc); \
+    if(new_ls4b < (asn).ls4b) { (asn).ms1b++; } \
+    (asn).ls4b = new_ls4b; \
+} while(0);
+
+#define ASN_DEC(asn, dec) do { \
+    uint32_t new_ls4b = (asn).ls4b - (dec); \
+    if(new_ls4b > (asn).ls4b) { (asn).ms1b--; } \
+    (asn).ls4b = new_ls4b; \
+} while(0);
+
+#define ASN_COPY(dest, src) do { \
+    (dest) = (src); \
+} while(0);
+
+/* Returns the 32-bit diff between asn1 and asn2 */
+#define ASN_DIFF(asn1, asn2) \
+  ((asn1).ls4b - (asn2).ls4b)
+
+#define ASN_EQUAL(asn1, asn2) \
+  ((asn1).ls4b == (asn2).ls4b && (asn1).ms1b == (asn2).ms1b)
+
+#define ASN_DIVISOR_INIT(div, val_) do { \
+    (div).val = (val_); \
+    (div).asn_ms1b_remainder = ((0xffffffff % (val_)) + 1) % (val_); \
+} while(0);
+
+#define ASN_MOD(asn, div) \
+  ((uint16_t)((asn).ls4b % (div).val) \
+   + (uint16_t)((asn).ms1b * (div).asn_ms1b_remainder % (div).val)) \
+  % (div).val
+
+/* Slotframe number of an ASN (ALICE) */
+#define ASN_DEVISION(asn, div) \
+  ((uint16_t)((asn).ls4b / (div).val))
+
+#endif /* __TSCH_ASN_H__ */
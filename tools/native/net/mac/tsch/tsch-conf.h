@@ -0,0 +1,27 @@
+#ifndef __TSCH_CONF_H__
+#define __TSCH_CONF_H__
+
+#include "contiki.h"
+
+#define TSCH_HOPPING_SEQUENCE_16_16 (uint8_t[]){ 16, 17, 23, 18, 26, 15, 25, 22, 19, 11, 12, 13, 24, 14, 20, 21 }
+#define TSCH_HOPPING_SEQUENCE_4_4 (uint8_t[]){ 15, 25, 26, 20 }
+
+#ifdef TSCH_CONF_DEFAULT_HOPPING_SEQUENCE
+#define TSCH_DEFAULT_HOPPING_SEQUENCE TSCH_CONF_DEFAULT_HOPPING_SEQUENCE
+#else
+#define TSCH_DEFAULT_HOPPING_SEQUENCE TSCH_HOPPING_SEQUENCE_4_4
+#endif
+
+#ifdef TSCH_CONF_WITH_LINK_SELECTOR
+#define TSCH_WITH_LINK_SELECTOR TSCH_CONF_WITH_LINK_SELECTOR
+#else
+#define TSCH_WITH_LINK_SELECTOR 0
+#endif
+
+#ifdef TSCH_CONF_DEFAULT_TIMESLOT_LENGTH
+#define TSCH_DEFAULT_TIMESLOT_LENGTH TSCH_CONF_DEFAULT_TIMESLOT_LENGTH
+#else
+#define TSCH_DEFAULT_TIMESLOT_LENGTH 10000
+#endif
+
+#endif /* __TSCH_CONF_H__ */
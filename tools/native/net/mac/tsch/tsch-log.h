@@ -0,0 +1,8 @@
+#ifndef __TSCH_LOG_H__
+#define __TSCH_LOG_H__
+
+#define TSCH_LOG_ID_FROM_LINKADDR(addr) ((addr) ? (addr)->u8[LINKADDR_SIZE - 1] : 0)
+#define TSCH_LOG_ADD(log_type, init_code)
+#define tsch_log_process_pending()
+
+#endif /* __TSCH_LOG_H__ */
@@ -0,0 +1,4 @@
+#ifndef __TSCH_PACKET_H__
+#define __TSCH_PACKET_H__
+
+#endif /* __TSCH_PACKET_H__ */
@@ -0,0 +1,22 @@
+#ifndef __TSCH_PRIVATE_H__
+#define __TSCH_PRIVATE_H__
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "net/mac/tsch/tsch-asn.h"
+#include "net/mac/tsch/tsch-conf.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/mac.h"
+
+struct tsch_link;
+
+extern const linkaddr_t tsch_broadcast_address;
+extern const linkaddr_t tsch_eb_address;
+extern struct asn_t current_asn;
+extern uint8_t tsch_join_priority;
+extern struct tsch_link *current_link;
+
+/* Calls the sent callbacks of the dequeued packets, see native_process_run() */
+PROCESS_NAME(tsch_pending_events_process);
+
+#endif /* __TSCH_PRIVATE_H__ */
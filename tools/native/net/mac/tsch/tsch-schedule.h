@@ -0,0 +1,2 @@
+/* The real header lives in the tree */
+#include "../../../../../tsch/tsch-schedule.h"
@@ -0,0 +1,6 @@
+#ifndef __TSCH_SECURITY_H__
+#define __TSCH_SECURITY_H__
+
+#define LLSEC802154_ENABLED 0
+
+#endif /* __TSCH_SECURITY_H__ */
@@ -0,0 +1,38 @@
+#ifndef __TSCH_SLOT_OPERATION_H__
+#define __TSCH_SLOT_OPERATION_H__
+
+#include "contiki.h"
+#include "sys/rtimer.h"
+#include "lib/ringbufindex.h"
+
+/* Size of the ring buffer storing dequeued outgoing packets (only an array of pointers).
+ * Must be power of two, and greater or equal to QUEUEBUF_NUM */
+#ifdef TSCH_CONF_DEQUEUED_ARRAY_SIZE
+#define TSCH_DEQUEUED_ARRAY_SIZE TSCH_CONF_DEQUEUED_ARRAY_SIZE
+#else
+#if QUEUEBUF_CONF_NUM <= 8
+#define TSCH_DEQUEUED_ARRAY_SIZE 8
+#elif QUEUEBUF_CONF_NUM <= 16
+#define TSCH_DEQUEUED_ARRAY_SIZE 16
+#elif QUEUEBUF_CONF_NUM <= 32
+#define TSCH_DEQUEUED_ARRAY_SIZE 32
+#else
+#define TSCH_DEQUEUED_ARRAY_SIZE 64
+#endif
+#endif
+
+struct tsch_packet;
+
+/* A ringbuf storing outgoing packets after they were dequeued.
+ * Will be processed layer by tsch_tx_process_pending */
+extern struct ringbufindex dequeued_ringbuf;
+extern struct tsch_packet *dequeued_array[TSCH_DEQUEUED_ARRAY_SIZE];
+
+/* Returns a 0 if the lock is free, 1 if it is taken */
+int tsch_is_locked(void);
+/* Lock TSCH (no link operation) */
+int tsch_get_lock(void);
+/* Release TSCH lock */
+void tsch_release_lock(void);
+
+#endif /* __TSCH_SLOT_OPERATION_H__ */
@@ -0,0 +1,50 @@
+#ifndef NBR_TABLE_H_
+#define NBR_TABLE_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+#define NBR_TABLE_MAX_NEIGHBORS NBR_TABLE_CONF_MAX_NEIGHBORS
+
+typedef void nbr_table_item_t;
+
+typedef struct nbr_table {
+  int item_size;
+  void *data;
+  linkaddr_t keys[NBR_TABLE_MAX_NEIGHBORS];
+  unsigned char used[NBR_TABLE_MAX_NEIGHBORS];
+} nbr_table_t;
+
+#define NBR_TABLE(type, name) \
+  static type _##name##_mem[NBR_TABLE_MAX_NEIGHBORS]; \
+  static nbr_table_t name##_struct = { sizeof(type), (void *)_##name##_mem }; \
+  static nbr_table_t *name = &name##_struct
+
+#define NBR_TABLE_GLOBAL(type, name) \
+  static type _##name##_mem[NBR_TABLE_MAX_NEIGHBORS]; \
+  static nbr_table_t name##_struct = { sizeof(type), (void *)_##name##_mem }; \
+  nbr_table_t *name = &name##_struct
+
+#define NBR_TABLE_DECLARE(name) extern nbr_table_t *name
+
+typedef enum {
+  NBR_TABLE_REASON_UNDEFINED,
+  NBR_TABLE_REASON_RPL_DIO,
+  NBR_TABLE_REASON_RPL_DAO,
+  NBR_TABLE_REASON_RPL_DIS,
+  NBR_TABLE_REASON_ROUTE,
+  NBR_TABLE_REASON_IPV6_ND,
+  NBR_TABLE_REASON_MAC,
+  NBR_TABLE_REASON_LLSEC,
+  NBR_TABLE_REASON_LINK_STATS,
+} nbr_table_reason_t;
+
+nbr_table_item_t *nbr_table_head(nbr_table_t *table);
+nbr_table_item_t *nbr_table_next(nbr_table_t *table, nbr_table_item_t *item);
+nbr_table_item_t *nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr,
+                                       nbr_table_reason_t reason, void *data);
+nbr_table_item_t *nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr);
+int nbr_table_remove(nbr_table_t *table, nbr_table_item_t *item);
+linkaddr_t *nbr_table_get_lladdr(nbr_table_t *table, const nbr_table_item_t *item);
+
+#endif /* NBR_TABLE_H_ */
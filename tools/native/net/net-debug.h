@@ -0,0 +1,17 @@
+#ifndef NET_DEBUG_H_
+#define NET_DEBUG_H_
+
+#define DEBUG_NONE      0
+#define DEBUG_PRINT     1
+#define DEBUG_ANNOTATE  2
+#define DEBUG_FULL      DEBUG_ANNOTATE | DEBUG_PRINT
+
+#endif /* NET_DEBUG_H_ */
+
+/* Like uip-debug.h, PRINTF follows the DEBUG of the including file */
+#undef PRINTF
+#if (DEBUG) & DEBUG_PRINT
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
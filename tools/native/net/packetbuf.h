@@ -0,0 +1,41 @@
+#ifndef PACKETBUF_H_
+#define PACKETBUF_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+typedef uint16_t packetbuf_attr_t;
+
+enum {
+  PACKETBUF_ATTR_NONE,
+  PACKETBUF_ATTR_CHANNEL,
+  PACKETBUF_ATTR_NETWORK_ID,
+  PACKETBUF_ATTR_LINK_QUALITY,
+  PACKETBUF_ATTR_RSSI,
+  PACKETBUF_ATTR_TIMESTAMP,
+  PACKETBUF_ATTR_MAC_SEQNO,
+  PACKETBUF_ATTR_MAC_ACK,
+  PACKETBUF_ATTR_FRAME_TYPE,
+  PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+  PACKETBUF_ATTR_TSCH_SLOTFRAME,
+  PACKETBUF_ATTR_TSCH_TIMESLOT,
+  PACKETBUF_ATTR_TSCH_CHANNEL_OFFSET,
+
+  PACKETBUF_ADDR_SENDER,
+  PACKETBUF_ADDR_RECEIVER,
+  PACKETBUF_ADDR_ESENDER,
+  PACKETBUF_ADDR_ERECEIVER,
+
+  PACKETBUF_ATTR_MAX
+};
+
+#define PACKETBUF_ADDR_FIRST PACKETBUF_ADDR_SENDER
+#define PACKETBUF_NUM_ADDRS (PACKETBUF_ATTR_MAX - PACKETBUF_ADDR_FIRST)
+
+void packetbuf_clear(void);
+int packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val);
+packetbuf_attr_t packetbuf_attr(uint8_t type);
+int packetbuf_set_addr(uint8_t type, const linkaddr_t *addr);
+const linkaddr_t *packetbuf_addr(uint8_t type);
+
+#endif /* PACKETBUF_H_ */
@@ -0,0 +1,15 @@
+#ifndef QUEUEBUF_H_
+#define QUEUEBUF_H_
+
+#include "net/packetbuf.h"
+
+#define QUEUEBUF_NUM QUEUEBUF_CONF_NUM
+
+struct queuebuf;
+
+struct queuebuf *queuebuf_new_from_packetbuf(void);
+void queuebuf_free(struct queuebuf *b);
+packetbuf_attr_t queuebuf_attr(struct queuebuf *b, uint8_t type);
+linkaddr_t *queuebuf_addr(struct queuebuf *b, uint8_t type);
+
+#endif /* QUEUEBUF_H_ */
@@ -0,0 +1,4 @@
+#ifndef RPL_CONF_H
+#define RPL_CONF_H
+
+#endif /* RPL_CONF_H */
@@ -0,0 +1,6 @@
+#ifndef RPL_PRIVATE_H
+#define RPL_PRIVATE_H
+
+#include "net/rpl/rpl.h"
+
+#endif /* RPL_PRIVATE_H */
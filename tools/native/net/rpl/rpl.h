@@ -0,0 +1,21 @@
+#ifndef RPL_H
+#define RPL_H
+
+#include "contiki.h"
+
+typedef uint16_t rpl_rank_t;
+
+struct rpl_dag {
+  rpl_rank_t rank;
+};
+typedef struct rpl_dag rpl_dag_t;
+
+struct rpl_instance {
+  rpl_dag_t *current_dag;
+  rpl_rank_t min_hoprankinc;
+};
+typedef struct rpl_instance rpl_instance_t;
+
+rpl_instance_t *rpl_get_default_instance(void);
+
+#endif /* RPL_H */
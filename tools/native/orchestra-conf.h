@@ -0,0 +1,22 @@
+#ifndef __ORCHESTRA_CONF_H__
+#define __ORCHESTRA_CONF_H__
+
+#ifdef ORCHESTRA_CONF_UNICAST_PERIOD
+#define ORCHESTRA_UNICAST_PERIOD ORCHESTRA_CONF_UNICAST_PERIOD
+#else
+#define ORCHESTRA_UNICAST_PERIOD 17
+#endif
+
+#ifdef ORCHESTRA_CONF_UNICAST_SENDER_BASED
+#define ORCHESTRA_UNICAST_SENDER_BASED ORCHESTRA_CONF_UNICAST_SENDER_BASED
+#else
+#define ORCHESTRA_UNICAST_SENDER_BASED 0
+#endif
+
+#define ORCHESTRA_COLLISION_FREE_HASH 0
+#define ORCHESTRA_MAX_HASH 0x7fff
+
+#define ORCHESTRA_LINKADDR_HASH(addr)             ((addr != NULL) ? (addr)->u8[LINKADDR_SIZE - 1] : -1)
+#define ORCHESTRA_LINKADDR_HASH2(addr1, addr2)    ((addr1)->u8[LINKADDR_SIZE - 1] + 264 * (addr2)->u8[LINKADDR_SIZE - 1])
+
+#endif /* __ORCHESTRA_CONF_H__ */
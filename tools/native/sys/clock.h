@@ -0,0 +1,8 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+typedef unsigned long clock_time_t;
+
+#define CLOCK_SECOND 128
+
+#endif /* CLOCK_H_ */
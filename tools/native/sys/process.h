@@ -0,0 +1,54 @@
+#ifndef PROCESS_H_
+#define PROCESS_H_
+
+/* Minimal protothread-based processes: enough for PROCESS_WAIT_EVENT_UNTIL
+ * and process_poll(). native_process_run() plays the role of the scheduler. */
+
+typedef unsigned char process_event_t;
+typedef void *process_data_t;
+
+#define PROCESS_EVENT_NONE  0x80
+#define PROCESS_EVENT_INIT  0x81
+#define PROCESS_EVENT_POLL  0x82
+
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED  2
+#define PT_ENDED   3
+
+struct pt {
+  unsigned short lc;
+};
+
+struct process {
+  struct process *next;
+  const char *name;
+  char (* thread)(struct pt *, process_event_t, process_data_t);
+  struct pt pt;
+  unsigned char running, needspoll;
+};
+
+#define PROCESS_THREAD(name, ev, data) \
+  static char process_thread_##name(struct pt *process_pt, \
+                                    process_event_t ev, process_data_t data)
+
+#define PROCESS_NAME(name) extern struct process name
+
+#define PROCESS(name, strname) \
+  PROCESS_THREAD(name, ev, data); \
+  struct process name = { NULL, strname, process_thread_##name }
+
+#define PROCESS_BEGIN() { char PT_YIELD_FLAG = 1; (void)PT_YIELD_FLAG; \
+  switch(process_pt->lc) { case 0:
+#define PROCESS_END() } PT_YIELD_FLAG = 0; process_pt->lc = 0; return PT_ENDED; }
+#define PROCESS_WAIT_EVENT_UNTIL(c) do { PT_YIELD_FLAG = 0; \
+  process_pt->lc = __LINE__; case __LINE__: \
+  if(PT_YIELD_FLAG == 0 || !(c)) { return PT_YIELDED; } } while(0)
+#define PROCESS_WAIT_EVENT() PROCESS_WAIT_EVENT_UNTIL(1)
+
+void process_start(struct process *p, process_data_t data);
+void process_poll(struct process *p);
+/* Runs every polled process once. Returns the number of processes run. */
+int native_process_run(void);
+
+#endif /* PROCESS_H_ */
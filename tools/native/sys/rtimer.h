@@ -0,0 +1,10 @@
+#ifndef RTIMER_H_
+#define RTIMER_H_
+
+#include <stdint.h>
+
+typedef uint32_t rtimer_clock_t;
+
+#define RTIMER_SECOND 32768
+
+#endif /* RTIMER_H_ */
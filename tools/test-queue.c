@@ -0,0 +1,406 @@
+/*
+ * Host test of the TSCH neighbor queues over the ATRIA unicast slotframe,
+ * run by "make test" for each TSCH_QUEUE_CONF_UNSCHEDULABLE mode, with and
+ * without TSCH_QUEUE_CONF_LOOKAHEAD:
+ *   unschedulable  packets to a child that loses its route, then gets it
+ *                  back, go over the shared slotframe, stay parked or are
+ *                  dropped with MAC_TX_ERR as TSCH_QUEUE_UNSCHEDULABLE says,
+ *                  and none is lost
+ *   order          random enqueues of data and command frames, peeks,
+ *                  dequeues and slotframe starts: the packet dequeued is
+ *                  always the one peeked, packets to a neighbor bound for the
+ *                  same cells leave in order and, with lookahead only, those
+ *                  of another slotframe may overtake them
+ *   eviction       with the pool full, a new packet takes the slot of a
+ *                  unicast neighbor's packet of no higher priority, never one
+ *                  of the broadcast queue
+ *
+ * Usage: test-queue [iterations]
+ * Prints every failed check and exits with 1 if there is any.
+ */
+
+#include "contiki.h"
+#include "orchestra.h"
+#include "native.h"
+#include "net/ip/uip.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/tsch/tsch.h"
+#include "net/mac/tsch/tsch-private.h"
+#include "net/mac/tsch/tsch-queue.h"
+#include "net/mac/tsch/tsch-schedule.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#undef printf
+
+#define PARENT_ID      1
+#define CHILD_ID(i)    (0x100 + (i))
+#define NUM_CHILDREN   12
+#define NUM_DESTS      (NUM_CHILDREN + 1) /* children, then the parent */
+#define NUM_PACKETS    6 /* queued to the child losing its route */
+#define NUM_ATTEMPTS   3 /* Tx opportunities without a route */
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while(0)
+
+void tsch_queue_init(void);
+
+static int failures;
+static int iterations = 100000;
+static int sent_status[MAC_TX_ERR_FATAL + 1];
+/*---------------------------------------------------------------------------*/
+static void
+packet_sent(void *ptr, int status, int transmissions)
+{
+  if(status >= 0 && status <= MAC_TX_ERR_FATAL) {
+    sent_status[status]++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+enqueue_frame(const linkaddr_t *addr, uint16_t seq, uint8_t network_id, uint8_t frame_type)
+{
+  packetbuf_clear();
+  packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, frame_type);
+  packetbuf_set_attr(PACKETBUF_ATTR_NETWORK_ID, network_id);
+  packetbuf_set_attr(PACKETBUF_ATTR_CHANNEL, seq);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, addr);
+  return tsch_queue_add_packet(addr, packet_sent, NULL) != NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+enqueue(const linkaddr_t *addr, uint16_t seq, uint8_t network_id)
+{
+  return enqueue_frame(addr, seq, network_id, FRAME802154_DATAFRAME);
+}
+/*---------------------------------------------------------------------------*/
+/* Acks and frees the packet last peeked from n, as the Tx slot does */
+static void
+dequeue(struct tsch_neighbor *n, struct tsch_packet *p)
+{
+  struct tsch_packet *r;
+
+  p->ret = MAC_TX_OK;
+  r = tsch_queue_remove_packet_from_queue(n);
+  CHECK(r == p);
+  if(r != NULL) {
+    tsch_queue_free_packet(r);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Next hops of the children, child 0 included or not. Child 1 has cells
+ * of its own in any case */
+static void
+set_routes(int with_child0)
+{
+  linkaddr_t addr;
+  int i;
+
+  native_routes_clear();
+  for(i = with_child0 ? 0 : 1; i < NUM_CHILDREN; i++) {
+    native_linkaddr(&addr, CHILD_ID(i));
+    native_routes_add(&addr, 1 + i % 3);
+  }
+  native_linkaddr(&addr, CHILD_ID(1));
+  unicast_per_neighbor_rpl_storing.child_added(&addr, 1);
+  native_process_run();
+  tsch_queue_invalidate_packet_selection();
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_tx_links(struct tsch_link **links)
+{
+  struct tsch_slotframe *sf = tsch_schedule_get_slotframe_by_handle(ALICE_UNICAST_SF_ID);
+  struct tsch_link *l;
+  int num_links = 0;
+
+  for(l = list_head(sf->links_list); l != NULL; l = list_item_next(l)) {
+    if(l->link_options & LINK_OPTION_TX) {
+      links[num_links++] = l;
+    }
+  }
+  return num_links;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_unschedulable(void)
+{
+  struct tsch_link *links[TSCH_SCHEDULE_MAX_LINKS];
+  struct tsch_link shared;
+  struct tsch_neighbor *n;
+  struct tsch_packet *p;
+  linkaddr_t addr;
+  int i, j, num_links, sent = 0, sent_late = 0;
+
+  set_routes(1);
+  native_linkaddr(&addr, CHILD_ID(0));
+  for(i = 0; i < NUM_PACKETS; i++) {
+    CHECK(enqueue(&addr, i, 0));
+  }
+  n = tsch_queue_get_nbr(&addr);
+  CHECK(n != NULL);
+
+  /* The route goes away: a Tx slot of the unicast slotframe, then of the
+   * shared one, at every attempt */
+  set_routes(0);
+  memset(&shared, 0, sizeof(shared));
+  shared.slotframe_handle = ALICE_BROADCAST_SF_ID;
+  shared.link_options = LINK_OPTION_TX | LINK_OPTION_SHARED;
+  num_links = get_tx_links(links);
+  CHECK(num_links > 0);
+  for(i = 0; i < NUM_ATTEMPTS && num_links > 0; i++) {
+    p = tsch_queue_get_packet_for_nbr(n, links[0]);
+    CHECK(p == NULL);
+    p = tsch_queue_get_packet_for_nbr(n, &shared);
+    if(p != NULL) {
+      dequeue(n, p);
+      sent++;
+    }
+    native_process_run();
+  }
+#if TSCH_QUEUE_UNSCHEDULABLE == TSCH_QUEUE_UNSCHEDULABLE_SHARED
+  CHECK(sent == NUM_ATTEMPTS);
+  CHECK(tsch_queue_unschedulable_shared == NUM_ATTEMPTS);
+  CHECK(tsch_queue_packet_count(&addr) == NUM_PACKETS - NUM_ATTEMPTS);
+#elif TSCH_QUEUE_UNSCHEDULABLE == TSCH_QUEUE_UNSCHEDULABLE_PARK
+  CHECK(sent == 0);
+  CHECK(tsch_queue_packet_count(&addr) == NUM_PACKETS);
+  /* Parked for too long: the head goes */
+  ASN_INC(current_asn, TSCH_QUEUE_PARK_TIMEOUT);
+  CHECK(tsch_queue_get_packet_for_nbr(n, links[0]) == NULL);
+  native_process_run();
+  CHECK(tsch_queue_unschedulable_dropped == 1);
+  CHECK(tsch_queue_packet_count(&addr) == NUM_PACKETS - 1);
+#else
+  /* Every packet looked at goes */
+  CHECK(sent == 0);
+  CHECK(tsch_queue_unschedulable_dropped == 2 * NUM_ATTEMPTS);
+  CHECK(tsch_queue_packet_count(&addr) == 0);
+#endif
+  CHECK(tsch_queue_unschedulable_shared == sent);
+
+  /* The route is back: what is left goes over the unicast slotframe */
+  set_routes(1);
+  for(i = 0; i < 2000 && tsch_queue_packet_count(&addr) > 0; i++) {
+    num_links = get_tx_links(links);
+    for(j = 0; j < num_links; j++) {
+      p = tsch_queue_get_packet_for_nbr(n, links[j]);
+      if(p != NULL) {
+        dequeue(n, p);
+        sent_late++;
+        break;
+      }
+    }
+    alice_callback_slotframe_start(i + 1, ORCHESTRA_UNICAST_PERIOD);
+    native_process_run();
+  }
+  CHECK(tsch_queue_packet_count(&addr) == 0);
+  CHECK(sent + sent_late + tsch_queue_unschedulable_dropped == NUM_PACKETS);
+  CHECK(sent_status[MAC_TX_ERR] == tsch_queue_unschedulable_dropped);
+
+  fprintf(stderr, "unschedulable: shared %d late %d dropped %u\n",
+          sent, sent_late, tsch_queue_unschedulable_dropped);
+}
+/*---------------------------------------------------------------------------*/
+static int
+dest_index(const linkaddr_t *dests, const linkaddr_t *addr)
+{
+  int i;
+  for(i = 0; i < NUM_DESTS; i++) {
+    if(linkaddr_cmp(&dests[i], addr)) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* The cells of test_order: the unicast slotframe, then the slotframe of the
+ * command frames at any timeslot or at one of other_timeslots */
+#define CELL_UNICAST   0
+#define CELL_ANY       1
+#define NUM_CELLS      4
+static const uint16_t other_timeslots[NUM_CELLS] = { 0, 0xffff, 3, 5 };
+
+static int
+cell_index(struct tsch_packet *p)
+{
+  int c;
+  if(queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_SLOTFRAME) == ALICE_UNICAST_SF_ID) {
+    return CELL_UNICAST;
+  }
+  for(c = CELL_ANY; c < NUM_CELLS; c++) {
+    if(queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_TIMESLOT) == other_timeslots[c]) {
+      return c;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* May packets of cells a and b go out over the same cell? */
+static int
+cells_shared(int a, int b)
+{
+  if(a == CELL_UNICAST || b == CELL_UNICAST) {
+    return a == b;
+  }
+  return a == b || a == CELL_ANY || b == CELL_ANY;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_order(void)
+{
+  struct tsch_link *links[TSCH_SCHEDULE_MAX_LINKS];
+  struct tsch_link other;
+  linkaddr_t dests[NUM_DESTS];
+  uint16_t next_seq[NUM_DESTS];
+  int last_seq[NUM_DESTS][NUM_CELLS];
+  int i, c, it, d, num_links, added = 0, sent = 0, reordered = 0, overtaken = 0;
+
+  set_routes(1);
+  for(i = 0; i < NUM_DESTS; i++) {
+    native_linkaddr(&dests[i], i < NUM_CHILDREN ? CHILD_ID(i) : PARENT_ID);
+    next_seq[i] = 0;
+    for(c = 0; c < NUM_CELLS; c++) {
+      last_seq[i][c] = -1;
+    }
+  }
+  /* A Tx cell of the slotframe select_packet leaves command frames to */
+  memset(&other, 0, sizeof(other));
+  other.slotframe_handle = 9;
+  other.link_options = LINK_OPTION_TX;
+
+  srand(7);
+  for(it = 0; it < iterations; it++) {
+    int op = rand() % 10;
+    if(op < 4) {
+      d = rand() % NUM_DESTS;
+      native_set_default_cell(9, other_timeslots[CELL_ANY + rand() % (NUM_CELLS - 1)], 0);
+      if(enqueue_frame(&dests[d], next_seq[d], 0,
+                       rand() % 4 ? FRAME802154_DATAFRAME : FRAME802154_CMDFRAME)) {
+        next_seq[d]++;
+        added++;
+      }
+    } else if(op < 9) {
+      struct tsch_neighbor *n = NULL;
+      struct tsch_packet *p;
+      num_links = get_tx_links(links);
+      if(num_links == 0) {
+        continue;
+      }
+      if(rand() % 4) {
+        p = tsch_queue_get_unicast_packet_for_any(&n, links[rand() % num_links]);
+      } else {
+        other.timeslot = other_timeslots[CELL_ANY + 1 + rand() % (NUM_CELLS - 2)];
+        n = tsch_queue_get_nbr(&dests[rand() % NUM_DESTS]);
+        p = n != NULL ? tsch_queue_get_packet_for_nbr(n, &other) : NULL;
+      }
+      if(p != NULL && rand() % 4) {
+        int cell = cell_index(p);
+        d = dest_index(dests, queuebuf_addr(p->qb, PACKETBUF_ADDR_RECEIVER));
+        CHECK(d != -1 && cell != -1);
+        if(d != -1 && cell != -1) {
+          int seq = queuebuf_attr(p->qb, PACKETBUF_ATTR_CHANNEL);
+          /* Sent after a later packet to the same destination */
+          for(c = 0; c < NUM_CELLS; c++) {
+            if(seq < last_seq[d][c]) {
+              if(cells_shared(cell, c)) {
+                reordered++;
+              } else {
+                overtaken++;
+              }
+            }
+          }
+          last_seq[d][cell] = seq;
+        }
+        dequeue(n, p);
+        sent++;
+      }
+    } else {
+      alice_callback_slotframe_start(it / 10, ORCHESTRA_UNICAST_PERIOD);
+      native_process_run();
+    }
+  }
+  native_set_default_cell(9, 0xffff, 0);
+  CHECK(sent > 0);
+  CHECK(reordered == 0);
+#if TSCH_QUEUE_LOOKAHEAD == 1
+  CHECK(overtaken == 0);
+#else
+  CHECK(overtaken > 0);
+#endif
+
+  fprintf(stderr, "order: added %d sent %d reordered %d overtaken %d\n",
+          added, sent, reordered, overtaken);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_eviction(void)
+{
+#if TSCH_QUEUE_EVICTION == TSCH_QUEUE_EVICT_LONGEST
+  linkaddr_t child0, child1;
+  int num_broadcast = 0, num_child0 = 0;
+
+  tsch_queue_reset();
+  native_linkaddr(&child0, CHILD_ID(0));
+  native_linkaddr(&child1, CHILD_ID(1));
+
+  /* The broadcast queue furthest above its reservation, then child 0 with
+   * control packets only, up to a full pool */
+  while(num_broadcast < QUEUEBUF_NUM / 2 + 1
+        && enqueue(&tsch_broadcast_address, 0, UIP_PROTO_ICMP6)) {
+    num_broadcast++;
+  }
+  while(enqueue(&child0, 0, UIP_PROTO_ICMP6)) {
+    num_child0++;
+  }
+  CHECK(tsch_queue_packet_count(&tsch_broadcast_address) == num_broadcast);
+  CHECK(num_broadcast + num_child0 == QUEUEBUF_NUM);
+
+#if TSCH_QUEUE_NUM_CLASSES > 1
+  /* Bulk data does not take the place of control packets */
+  CHECK(!enqueue(&child1, 0, 0));
+  CHECK(tsch_queue_packet_count(&child0) == num_child0);
+#endif
+  /* A control packet does, from child 0 rather than the broadcast queue */
+  CHECK(enqueue(&child1, 0, UIP_PROTO_ICMP6));
+  CHECK(tsch_queue_packet_count(&child1) == 1);
+  CHECK(tsch_queue_packet_count(&child0) == num_child0 - 1);
+  CHECK(tsch_queue_packet_count(&tsch_broadcast_address) == num_broadcast);
+
+  fprintf(stderr, "eviction: broadcast %d child %d evicted %u\n",
+          num_broadcast, num_child0, tsch_queue_evicted);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  linkaddr_t addr;
+
+  if(argc > 1) {
+    iterations = atoi(argv[1]);
+  }
+
+  tsch_queue_init();
+  tsch_schedule_init();
+  native_linkaddr(&addr, 2);
+  linkaddr_set_node_addr(&addr);
+  native_linkaddr(&orchestra_parent_linkaddr, PARENT_ID);
+  native_set_rank(512);
+  unicast_per_neighbor_rpl_storing.init(ALICE_UNICAST_SF_ID);
+
+  fprintf(stderr, "unschedulable %d, lookahead %d\n",
+          TSCH_QUEUE_UNSCHEDULABLE, TSCH_QUEUE_LOOKAHEAD);
+  test_unschedulable();
+  test_order();
+  test_eviction();
+
+  return failures ? 1 : 0;
+}
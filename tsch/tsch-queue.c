@@ -47,6 +47,9 @@
 #include "lib/memb.h"
 #include "lib/random.h"
 #include "net/queuebuf.h"
+#include "net/packetbuf.h"
+#include "net/ip/uip.h"
+#include "net/mac/frame802154.h"
 #include "net/mac/rdc.h"
 #include "net/mac/tsch/tsch.h"
 #include "net/mac/tsch/tsch-private.h"
@@ -80,6 +83,10 @@
 #error TSCH_QUEUE_NUM_PER_NEIGHBOR must be power of two
 #endif
 
+#if (TSCH_QUEUE_NUM_PER_CLASS & (TSCH_QUEUE_NUM_PER_CLASS - 1)) != 0
+#error TSCH_QUEUE_NUM_PER_CLASS must be power of two
+#endif
+
 #ifdef ALICE_CALLBACK_PACKET_SELECTION // atria packet selection
 int ALICE_CALLBACK_PACKET_SELECTION(uint16_t* ts, uint16_t* choff, const linkaddr_t rx_lladdr);
 int IMP_CALLBACK_PACKET_SELECTION(uint16_t* ts, uint16_t* choff, const linkaddr_t rx_lladdr, uint16_t cell_seq);
@@ -95,12 +102,224 @@ LIST(neighbor_list);
 struct tsch_neighbor *n_broadcast;
 struct tsch_neighbor *n_eb;
 
+/* Enqueue failures per class */
+uint16_t tsch_queue_class_overflow[TSCH_QUEUE_NUM_CLASSES];
+/* Packets dropped to make room for another neighbor's */
+uint16_t tsch_queue_evicted;
+/* Packets without a unicast link to their destination, and their fate */
+uint16_t tsch_queue_unschedulable;
+uint16_t tsch_queue_unschedulable_shared;
+uint16_t tsch_queue_unschedulable_late;
+uint16_t tsch_queue_unschedulable_dropped;
+
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+/* Per-neighbor memo of the ATRIA packet selection, indexed like neighbor_memb.
+ * Valid as long as generation matches selection_generation. */
+struct selection_memo {
+  uint32_t generation;
+  int8_t r; /* ALICE_CALLBACK_PACKET_SELECTION result */
+  uint8_t cell_valid;
+  uint16_t ts;
+  uint16_t choff;
+  /* Cell-level selection, for one (cell_seq, schedule_num) */
+  uint16_t cell_seq;
+  uint16_t schedule_num;
+  uint16_t cell_ts;
+  uint16_t cell_choff;
+};
+static struct selection_memo selection_memo[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES];
+static volatile uint32_t selection_generation = 1;
+#endif
+
+/* Neighbors that may be in backoff, one bit per neighbor_memb entry. Bits are
+ * set and cleared from the slot operation only (tsch_queue_backoff_inc and
+ * tsch_queue_update_all_backoff_windows); a bit left set after a reset or a
+ * neighbor removal is cleared at the next update. */
+#define BACKOFF_BITMAP_WORDS ((TSCH_QUEUE_MAX_NEIGHBOR_QUEUES + 31) / 32)
+static uint32_t backoff_bitmap[BACKOFF_BITMAP_WORDS];
+
+/* Ready list: the non-broadcast neighbors that may have packets, candidates
+ * of tsch_queue_get_unicast_packet_for_any. A circular list through
+ * ready_next, indexed like neighbor_memb and only changed by the slot
+ * operation or with the TSCH lock. tsch_queue_add_packet posts the neighbor
+ * to ready_wakeup_ringbuf, drained into the list by the slot operation;
+ * neighbors found empty are unlinked as the list is walked. */
+#define READY_NONE 0xff
+#define READY_UNLINKED 0
+#define READY_LINKED 1
+#define READY_REMOVED 2 /* Being removed, stale wakeups are ignored */
+static uint8_t ready_next[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES];
+static uint8_t ready_state[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES];
+static uint8_t ready_tail = READY_NONE;
+static uint8_t ready_count;
+static struct ringbufindex ready_wakeup_ringbuf;
+static uint8_t ready_wakeup_array[TSCH_DEQUEUED_ARRAY_SIZE];
+/* Set when a wakeup did not fit the ring: rebuild from neighbor_list */
+static volatile uint8_t ready_rescan;
+
+#if TSCH_QUEUE_MAX_NEIGHBOR_QUEUES >= READY_NONE
+#error TSCH_QUEUE_MAX_NEIGHBOR_QUEUES must be lower than 255
+#endif
+
+#if TSCH_QUEUE_WITH_NBR_HASH
+/* Hash index of neighbor_list: neighbor_memb indices, by linear probing from
+ * the hash of the address. Only changed with the TSCH lock */
+#define NBR_HASH_EMPTY 0xff
+static uint8_t nbr_hash[TSCH_QUEUE_NBR_HASH_SIZE];
+#endif
+
+#if TSCH_QUEUE_NUM_CLASSES > 1 || TSCH_QUEUE_LOOKAHEAD > 1
+/* Position of the packet last returned by tsch_queue_get_packet_for_nbr, per
+ * neighbor and indexed like neighbor_memb: the one to remove after its TX,
+ * even if a higher class got a packet in the meantime */
+struct peeked_packet {
+  uint8_t class;
+  uint8_t offset; /* From the head of the class ring */
+};
+static struct peeked_packet peeked[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES];
+#define TSCH_QUEUE_SET_PEEKED(n, c, o) do { \
+    struct peeked_packet *pp = &peeked[(n) - (struct tsch_neighbor *)neighbor_memb.mem]; \
+    pp->class = (c); \
+    pp->offset = (o); \
+  } while(0)
+#else
+#define TSCH_QUEUE_SET_PEEKED(n, c, o)
+#endif
+
+#if TSCH_QUEUE_NUM_CLASSES > 1 && TSCH_QUEUE_POLICY == TSCH_QUEUE_POLICY_WEIGHTED
+static const uint8_t class_weights[] = TSCH_QUEUE_CLASS_WEIGHTS;
+#endif
+
+#if TSCH_QUEUE_WITH_NBR_HASH
+/*---------------------------------------------------------------------------*/
+/* Home slot of an address in nbr_hash */
+static uint16_t
+tsch_queue_nbr_hash(const linkaddr_t *addr)
+{
+  uint16_t h = 0;
+  uint8_t i;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h = h * 31 + addr->u8[i];
+  }
+  /* Fibonacci hashing: neighbors often have consecutive addresses, which
+   * linear probing would otherwise put in one long cluster */
+  return (uint32_t)(h * 2654435769UL) >> (32 - TSCH_QUEUE_NBR_HASH_BITS);
+}
+/*---------------------------------------------------------------------------*/
+/* Index neighbor n. With the TSCH lock */
+static void
+tsch_queue_nbr_hash_add(const struct tsch_neighbor *n)
+{
+  uint16_t h = tsch_queue_nbr_hash(&n->addr);
+  while(nbr_hash[h] != NBR_HASH_EMPTY) {
+    h = (h + 1) & (TSCH_QUEUE_NBR_HASH_SIZE - 1);
+  }
+  nbr_hash[h] = n - (struct tsch_neighbor *)neighbor_memb.mem;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove neighbor n from the index, moving back the entries probed past it
+ * so that no lookup stops short. With the TSCH lock */
+static void
+tsch_queue_nbr_hash_remove(const struct tsch_neighbor *n)
+{
+  struct tsch_neighbor *neighbors = (struct tsch_neighbor *)neighbor_memb.mem;
+  uint16_t mask = TSCH_QUEUE_NBR_HASH_SIZE - 1;
+  uint16_t hole = tsch_queue_nbr_hash(&n->addr);
+  uint16_t j, home;
+
+  while(nbr_hash[hole] != n - neighbors) {
+    hole = (hole + 1) & mask;
+  }
+  for(j = (hole + 1) & mask; nbr_hash[j] != NBR_HASH_EMPTY; j = (j + 1) & mask) {
+    home = tsch_queue_nbr_hash(&neighbors[nbr_hash[j]].addr);
+    /* The entry may fill the hole if the hole is not before its home slot */
+    if(((j - home) & mask) >= ((j - hole) & mask)) {
+      nbr_hash[hole] = nbr_hash[j];
+      hole = j;
+    }
+  }
+  nbr_hash[hole] = NBR_HASH_EMPTY;
+}
+#endif /* TSCH_QUEUE_WITH_NBR_HASH */
+/*---------------------------------------------------------------------------*/
+/* Append neighbor i at the end of the ready list */
+static void
+tsch_queue_ready_link(uint8_t i)
+{
+  if(ready_state[i] == READY_UNLINKED) {
+    if(ready_tail == READY_NONE) {
+      ready_next[i] = i;
+    } else {
+      ready_next[i] = ready_next[ready_tail];
+      ready_next[ready_tail] = i;
+    }
+    ready_tail = i;
+    ready_state[i] = READY_LINKED;
+    ready_count++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Unlink neighbor i, which follows prev in the ready list */
+static void
+tsch_queue_ready_unlink(uint8_t prev, uint8_t i)
+{
+  if(ready_next[i] == i) {
+    ready_tail = READY_NONE;
+  } else {
+    ready_next[prev] = ready_next[i];
+    if(ready_tail == i) {
+      ready_tail = prev;
+    }
+  }
+  ready_state[i] = READY_UNLINKED;
+  ready_count--;
+}
+/*---------------------------------------------------------------------------*/
+/* Post neighbor n, which just got a packet, to the slot operation */
+static void
+tsch_queue_ready_wakeup(const struct tsch_neighbor *n)
+{
+  int16_t put_index = ringbufindex_peek_put(&ready_wakeup_ringbuf);
+  if(put_index != -1) {
+    ready_wakeup_array[put_index] = n - (struct tsch_neighbor *)neighbor_memb.mem;
+    ringbufindex_put(&ready_wakeup_ringbuf);
+  } else {
+    ready_rescan = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Link the neighbors posted since the last call. From the slot operation */
+static void
+tsch_queue_ready_update(void)
+{
+  int16_t get_index;
+  uint8_t i;
+  if(ready_rescan) {
+    struct tsch_neighbor *n = list_head(neighbor_list);
+    ready_rescan = 0;
+    while(n != NULL) {
+      if(!n->is_broadcast && !tsch_queue_is_empty(n)) {
+        tsch_queue_ready_link(n - (struct tsch_neighbor *)neighbor_memb.mem);
+      }
+      n = list_item_next(n);
+    }
+  }
+  while((get_index = ringbufindex_peek_get(&ready_wakeup_ringbuf)) != -1) {
+    i = ready_wakeup_array[get_index];
+    ringbufindex_get(&ready_wakeup_ringbuf);
+    if(neighbor_memb.count[i]) {
+      tsch_queue_ready_link(i);
+    }
+  }
+}
+
 /*---------------------------------------------------------------------------*/
 /* Add a TSCH neighbor */
 struct tsch_neighbor *
 tsch_queue_add_nbr(const linkaddr_t *addr)
 {
   struct tsch_neighbor *n = NULL;
+  uint8_t class;
   /* If we have an entry for this neighbor already, we simply update it */
   n = tsch_queue_get_nbr(addr);
   if(n == NULL) { 
@@ -110,13 +329,25 @@ tsch_queue_add_nbr(const linkaddr_t *addr)
       if(n != NULL) {
         /* Initialize neighbor entry */
         memset(n, 0, sizeof(struct tsch_neighbor));
-        ringbufindex_init(&n->tx_ringbuf, TSCH_QUEUE_NUM_PER_NEIGHBOR);
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+        selection_memo[n - (struct tsch_neighbor *)neighbor_memb.mem].generation = 0;
+#endif
+        TSCH_QUEUE_SET_PEEKED(n, 0, 0);
+        ready_state[n - (struct tsch_neighbor *)neighbor_memb.mem] = READY_UNLINKED;
+        for(class = 0; class < TSCH_QUEUE_NUM_CLASSES; class++) {
+          ringbufindex_init(&n->tx_ringbuf[class], TSCH_QUEUE_NUM_PER_CLASS);
+        }
         linkaddr_copy(&n->addr, addr);
+        n->min_packets = TSCH_QUEUE_NBR_MIN_PACKETS;
+        n->max_packets = TSCH_QUEUE_NBR_MAX_PACKETS;
         n->is_broadcast = linkaddr_cmp(addr, &tsch_eb_address)
           || linkaddr_cmp(addr, &tsch_broadcast_address);
         tsch_queue_backoff_reset(n);
         /* Add neighbor to the list */
         list_add(neighbor_list, n);
+#if TSCH_QUEUE_WITH_NBR_HASH
+        tsch_queue_nbr_hash_add(n);
+#endif
       }
       tsch_release_lock();
     }
@@ -129,6 +360,17 @@ struct tsch_neighbor *
 tsch_queue_get_nbr(const linkaddr_t *addr)
 {
   if(!tsch_is_locked()) {
+#if TSCH_QUEUE_WITH_NBR_HASH
+    struct tsch_neighbor *neighbors = (struct tsch_neighbor *)neighbor_memb.mem;
+    uint16_t h = tsch_queue_nbr_hash(addr);
+    uint8_t i;
+    while((i = nbr_hash[h]) != NBR_HASH_EMPTY) {
+      if(linkaddr_cmp(&neighbors[i].addr, addr)) {
+        return &neighbors[i];
+      }
+      h = (h + 1) & (TSCH_QUEUE_NBR_HASH_SIZE - 1);
+    }
+#else
     struct tsch_neighbor *n = list_head(neighbor_list);
     while(n != NULL) {
       if(linkaddr_cmp(&n->addr, addr)) {
@@ -136,10 +378,18 @@ tsch_queue_get_nbr(const linkaddr_t *addr)
       }
       n = list_item_next(n);
     }
+#endif
   }
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Index of a TSCH neighbor in the neighbor pool */
+int
+tsch_queue_nbr_index(const struct tsch_neighbor *n)
+{
+  return n - (struct tsch_neighbor *)neighbor_memb.mem;
+}
+/*---------------------------------------------------------------------------*/
 /* Get a TSCH time source (we currently assume there is only one) */
 struct tsch_neighbor *
 tsch_queue_get_time_source(void)
@@ -198,6 +448,135 @@ tsch_queue_update_time_source(const linkaddr_t *new_addr)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+/* Class of the packet in packetbuf, clipped to the configured classes */
+static uint8_t
+tsch_queue_packet_class(void)
+{
+  int class = -1;
+#ifdef TSCH_CALLBACK_PACKET_CLASS
+  class = TSCH_CALLBACK_PACKET_CLASS();
+#endif
+  if(class < 0) {
+    if(packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE) != FRAME802154_DATAFRAME
+       || packetbuf_attr(PACKETBUF_ATTR_NETWORK_ID) == UIP_PROTO_ICMP6) {
+      class = TSCH_QUEUE_CLASS_CONTROL;
+    } else {
+      class = TSCH_QUEUE_CLASS_BULK;
+    }
+  }
+  return MIN(class, TSCH_QUEUE_NUM_CLASSES - 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Class to dequeue from next, per TSCH_QUEUE_POLICY. -1 if the queue is empty.
+ * Read-only, as tsch_queue_get_packet_for_nbr */
+static int
+tsch_queue_select_class(const struct tsch_neighbor *n)
+{
+#if TSCH_QUEUE_NUM_CLASSES > 1
+  int class, first = -1;
+  for(class = 0; class < TSCH_QUEUE_NUM_CLASSES; class++) {
+    if(!ringbufindex_empty(&n->tx_ringbuf[class])) {
+#if TSCH_QUEUE_POLICY == TSCH_QUEUE_POLICY_WEIGHTED
+      /* Highest class with credit left; if none, a new round starts with
+       * the highest non-empty class */
+      if(n->tx_credit[class] > 0) {
+        return class;
+      }
+      if(first == -1) {
+        first = class;
+      }
+#else
+      return class;
+#endif
+    }
+  }
+  return first;
+#else
+  return ringbufindex_empty(&n->tx_ringbuf[0]) ? -1 : 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* Number of packets of the pool held by a neighbor */
+static int
+tsch_queue_nbr_packet_count(const struct tsch_neighbor *n)
+{
+  int count = 0;
+  uint8_t class;
+  for(class = 0; class < TSCH_QUEUE_NUM_CLASSES; class++) {
+    count += ringbufindex_elements(&n->tx_ringbuf[class]);
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+#if TSCH_QUEUE_EVICTION == TSCH_QUEUE_EVICT_LONGEST
+/* Does neighbor n hold a packet of class new_class or of a lower priority? */
+static int
+tsch_queue_nbr_has_evictable(const struct tsch_neighbor *n, uint8_t new_class)
+{
+  uint8_t class;
+  for(class = new_class; class < TSCH_QUEUE_NUM_CLASSES; class++) {
+    if(!ringbufindex_empty(&n->tx_ringbuf[class])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* The pool is full: reclaim a packet slot for a packet of class new_class
+ * of neighbor n, see TSCH_QUEUE_EVICT_LONGEST. Neither the EB and broadcast
+ * queues nor packets of a higher priority than new_class are evicted. The
+ * evicted packet is freed, and copied to *evicted for its sent callback
+ * once the new packet is in the queue. Returns 1 on eviction */
+static int
+tsch_queue_evict(const struct tsch_neighbor *n, uint8_t new_class, struct tsch_packet *evicted)
+{
+  struct tsch_neighbor *curr_nbr = list_head(neighbor_list);
+  struct tsch_neighbor *victim = NULL;
+  struct tsch_packet *p = NULL;
+  int excess, victim_excess = 0;
+  int n_excess = tsch_queue_nbr_packet_count(n) - n->min_packets;
+  int class;
+
+  while(curr_nbr != NULL) {
+    excess = tsch_queue_nbr_packet_count(curr_nbr) - curr_nbr->min_packets;
+    if(curr_nbr != n && !curr_nbr->is_broadcast && excess > victim_excess
+       && tsch_queue_nbr_has_evictable(curr_nbr, new_class)) {
+      victim = curr_nbr;
+      victim_excess = excess;
+    }
+    curr_nbr = list_item_next(curr_nbr);
+  }
+  if(victim == NULL || (n_excess >= 0 && victim_excess <= n_excess + 1)) {
+    return 0;
+  }
+
+  if(tsch_get_lock()) {
+    /* No slot operation until release: safe to take back the last put */
+    for(class = TSCH_QUEUE_NUM_CLASSES - 1; class >= new_class; class--) {
+      struct ringbufindex *r = &victim->tx_ringbuf[class];
+      if(!ringbufindex_empty(r)) {
+        r->put_ptr = (r->put_ptr - 1) & r->mask;
+        p = victim->tx_array[class][r->put_ptr];
+        break;
+      }
+    }
+    tsch_release_lock();
+  }
+  if(p == NULL) {
+    return 0;
+  }
+
+  PRINTF("TSCH-queue:! evict packet of %u for %u\n",
+         TSCH_LOG_ID_FROM_LINKADDR(&victim->addr), TSCH_LOG_ID_FROM_LINKADDR(&n->addr));
+  *evicted = *p;
+  evicted->ret = MAC_TX_ERR;
+  tsch_queue_free_packet(p);
+  tsch_queue_evicted++;
+  num_pktdrop_queue++;
+  return 1;
+}
+#endif
+/*---------------------------------------------------------------------------*/
 /* Flush a neighbor queue */
 static void
 tsch_queue_flush_nbr_queue(struct tsch_neighbor *n)
@@ -223,8 +602,21 @@ tsch_queue_remove_nbr(struct tsch_neighbor *n)
   if(n != NULL) {
     if(tsch_get_lock()) {
 
+      uint8_t i = n - (struct tsch_neighbor *)neighbor_memb.mem;
+      uint8_t prev;
+
       /* Remove neighbor from list */
       list_remove(neighbor_list, n);
+#if TSCH_QUEUE_WITH_NBR_HASH
+      tsch_queue_nbr_hash_remove(n);
+#endif
+
+      /* And from the ready list, for good */
+      if(ready_state[i] == READY_LINKED) {
+        for(prev = ready_tail; ready_next[prev] != i; prev = ready_next[prev]);
+        tsch_queue_ready_unlink(prev, i);
+      }
+      ready_state[i] = READY_REMOVED;
 
       tsch_release_lock();
 
@@ -244,12 +636,21 @@ tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr)
   struct tsch_neighbor *n = NULL;
   int16_t put_index = -1;
   struct tsch_packet *p = NULL;
+  uint8_t class = 0;
+  struct tsch_packet evicted;
+  int has_evicted = 0;
   if(!tsch_is_locked()) {
     n = tsch_queue_add_nbr(addr);
     if(n != NULL) {
-      put_index = ringbufindex_peek_put(&n->tx_ringbuf);  
-      if(put_index != -1) {
-        p = memb_alloc(&packet_memb); 
+      class = tsch_queue_packet_class();
+      put_index = ringbufindex_peek_put(&n->tx_ringbuf[class]);
+      if(put_index != -1 && tsch_queue_nbr_packet_count(n) < n->max_packets) {
+#if TSCH_QUEUE_EVICTION == TSCH_QUEUE_EVICT_LONGEST
+        if(memb_numfree(&packet_memb) == 0) {
+          has_evicted = tsch_queue_evict(n, class, &evicted);
+        }
+#endif
+        p = memb_alloc(&packet_memb);
         if(p != NULL) {
           /* Enqueue packet */
 #ifdef TSCH_CALLBACK_PACKET_READY
@@ -261,9 +662,17 @@ tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr)
             p->ptr = ptr;
             p->ret = MAC_TX_DEFERRED;
             p->transmissions = 0;
+            p->unschedulable = 0;
             /* Add to ringbuf (actual add committed through atomic operation) */
-            n->tx_array[put_index] = p;
-            ringbufindex_put(&n->tx_ringbuf);
+            n->tx_array[class][put_index] = p;
+            ringbufindex_put(&n->tx_ringbuf[class]);
+            if(!n->is_broadcast) {
+              tsch_queue_ready_wakeup(n);
+            }
+            if(has_evicted) {
+              /* Only now: the callback may send, overwriting packetbuf */
+              mac_call_sent_callback(evicted.sent, evicted.ptr, evicted.ret, evicted.transmissions);
+            }
             return p;
           } else {
             memb_free(&packet_memb, p);
@@ -271,12 +680,16 @@ tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr)
         } // p !=null
       } // put_index != -1
       tsch_queue_overflow++; //ksh.. //packet buffer is full. queue overflow.
+      tsch_queue_class_overflow[class]++;
 
     } // n != null // n=tsch_queue_add_nbr
   } //tsch_is_locked
 
+  if(has_evicted) {
+    mac_call_sent_callback(evicted.sent, evicted.ptr, evicted.ret, evicted.transmissions);
+  }
   num_pktdrop_queue++;
-  PRINTF("TSCH-queue:! add packet failed: %u %p %d %p %p\n", tsch_is_locked(), n, put_index, p, p ? p->qb : NULL);
+  PRINTF("TSCH-queue:! add packet failed: %u %p %u %d %p %p\n", tsch_is_locked(), n, class, put_index, p, p ? p->qb : NULL);
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -288,25 +701,114 @@ tsch_queue_packet_count(const linkaddr_t *addr)
   if(!tsch_is_locked()) {
     n = tsch_queue_add_nbr(addr);
     if(n != NULL) {
-      return ringbufindex_elements(&n->tx_ringbuf);
+      return tsch_queue_nbr_packet_count(n);
     }
   }
   return -1;
 }
 /*---------------------------------------------------------------------------*/
+/* Returns the number of packets of a class currently in the queue */
+int
+tsch_queue_class_packet_count(const linkaddr_t *addr, uint8_t class)
+{
+  struct tsch_neighbor *n = NULL;
+  if(!tsch_is_locked() && class < TSCH_QUEUE_NUM_CLASSES) {
+    n = tsch_queue_get_nbr(addr);
+    if(n != NULL) {
+      return ringbufindex_elements(&n->tx_ringbuf[class]);
+    }
+    return 0;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Set the share of the packet pool of a neighbor */
+int
+tsch_queue_set_nbr_quota(const linkaddr_t *addr, uint8_t min_packets, uint8_t max_packets)
+{
+  struct tsch_neighbor *n = NULL;
+  if(!tsch_is_locked() && min_packets <= max_packets) {
+    n = tsch_queue_add_nbr(addr);
+    if(n != NULL) {
+      n->min_packets = min_packets;
+      n->max_packets = max_packets;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove the packet at offset from the head of a class ring. Consumer side
+ * of the ring: from the slot operation, or with the TSCH lock */
+static struct tsch_packet *
+tsch_queue_remove_at(struct tsch_neighbor *n, int class, int offset)
+{
+  int16_t get_index;
+#if TSCH_QUEUE_LOOKAHEAD > 1
+  if(offset > 0) {
+    /* Out of the middle of the ring: move the packets ahead of it one
+     * slot towards the tail, over it, then drop the head slot. The put
+     * side only writes beyond the last packet, this stays lock-free */
+    struct tsch_packet *p;
+    int mask = TSCH_QUEUE_NUM_PER_CLASS - 1;
+    get_index = ringbufindex_peek_get(&n->tx_ringbuf[class]);
+    p = n->tx_array[class][(get_index + offset) & mask];
+    for(; offset > 0; offset--) {
+      n->tx_array[class][(get_index + offset) & mask] = n->tx_array[class][(get_index + offset - 1) & mask];
+    }
+    ringbufindex_get(&n->tx_ringbuf[class]);
+    return p;
+  }
+#endif
+  /* Get and remove packet from ringbuf (remove committed through an atomic operation */
+  get_index = ringbufindex_get(&n->tx_ringbuf[class]);
+  if(get_index != -1) {
+    return n->tx_array[class][get_index];
+  } else {
+    return NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
 /* Remove first packet from a neighbor queue */
 struct tsch_packet *
 tsch_queue_remove_packet_from_queue(struct tsch_neighbor *n)
 {
   if(!tsch_is_locked()) {
     if(n != NULL) {
-      /* Get and remove packet from ringbuf (remove committed through an atomic operation */
-      int16_t get_index = ringbufindex_get(&n->tx_ringbuf);
-      if(get_index != -1) {
-        return n->tx_array[get_index];
-      } else {
+      struct tsch_packet *p;
+      int class = tsch_queue_select_class(n);
+      int offset = 0;
+#if TSCH_QUEUE_NUM_CLASSES > 1 || TSCH_QUEUE_LOOKAHEAD > 1
+      /* Remove the packet that was peeked for TX, if still there */
+      struct peeked_packet *pp = &peeked[n - (struct tsch_neighbor *)neighbor_memb.mem];
+      if(pp->offset < ringbufindex_elements(&n->tx_ringbuf[pp->class])) {
+        class = pp->class;
+        offset = pp->offset;
+      }
+      pp->offset = 0;
+#endif
+      if(class == -1) {
         return NULL;
       }
+#if TSCH_QUEUE_NUM_CLASSES > 1 && TSCH_QUEUE_POLICY == TSCH_QUEUE_POLICY_WEIGHTED
+      if(n->tx_credit[class] == 0) {
+        /* New round */
+        uint8_t c;
+        for(c = 0; c < TSCH_QUEUE_NUM_CLASSES; c++) {
+          n->tx_credit[c] = c < sizeof(class_weights) ? MAX(class_weights[c], 1) : 1;
+        }
+      }
+      n->tx_credit[class]--;
+#endif
+      p = tsch_queue_remove_at(n, class, offset);
+      if(p != NULL && p->ret == MAC_TX_OK && (p->unschedulable & TSCH_PACKET_UNSCHEDULABLE)) {
+        if(p->unschedulable & TSCH_PACKET_VIA_SHARED) {
+          tsch_queue_unschedulable_shared++;
+        } else {
+          tsch_queue_unschedulable_late++;
+        }
+      }
+      return p;
     }
   }
   return NULL;
@@ -364,97 +866,240 @@ tsch_queue_free_unused_neighbors(void)
 int
 tsch_queue_is_empty(const struct tsch_neighbor *n)
 {
-  return !tsch_is_locked() && n != NULL && ringbufindex_empty(&n->tx_ringbuf);
+  return !tsch_is_locked() && n != NULL && tsch_queue_select_class(n) == -1;
 }
 /*---------------------------------------------------------------------------*/
-/* Returns the first packet from a neighbor queue */
-struct tsch_packet *
-tsch_queue_get_packet_for_nbr(const struct tsch_neighbor *n, struct tsch_link *link)
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+/* Forget all memoized packet selections, on ASFN or routing changes */
+void
+tsch_queue_invalidate_packet_selection(void)
 {
-  if(!tsch_is_locked()) {
-    int is_shared_link = link != NULL && link->link_options & LINK_OPTION_SHARED;
-    if(n != NULL) {
-      int16_t get_index = ringbufindex_peek_get(&n->tx_ringbuf);
-      if(get_index != -1 &&
-          !(is_shared_link && !tsch_queue_backoff_expired(n))) {    /* If this is a shared link,
-                                                                    make sure the backoff has expired */
+  selection_generation++;
+  if(selection_generation == 0) {
+    selection_generation = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Timeslot and channel offset of the ATRIA cell for a packet of neighbor n
+ * over a link. Returns 0 if there is no unicast link to rx_lladdr */
+static int
+alice_packet_selection(const struct tsch_neighbor *n, const linkaddr_t *rx_lladdr,
+                       const struct tsch_link *link, uint16_t *ts, uint16_t *choff)
+{
+  struct selection_memo *m = &selection_memo[n - (struct tsch_neighbor *)neighbor_memb.mem];
+
+  if(m->generation != selection_generation) {
+    m->ts = -1;
+    m->choff = -1;
+    m->r = ALICE_CALLBACK_PACKET_SELECTION(&m->ts, &m->choff, *rx_lladdr); //Decides packet_ts and packet_choff, checks rpl neighbor relations.
+    m->cell_valid = 0;
+    m->generation = selection_generation;
+  }
+  *ts = m->ts;
+  *choff = m->choff;
 
+#if IMP_METHOD3
+  if(m->r != 0 && link->schedule_num > 0) {
+    if(!m->cell_valid || m->cell_seq != link->cell_seq || m->schedule_num != link->schedule_num) {
+      m->cell_ts = m->ts;
+      m->cell_choff = m->choff;
+      SPE_CALLBACK_PACKET_SELECTION(&m->cell_ts, &m->cell_choff, *rx_lladdr, link->cell_seq, link->schedule_num);
+      m->cell_seq = link->cell_seq;
+      m->schedule_num = link->schedule_num;
+      m->cell_valid = 1;
+    }
+    *ts = m->cell_ts;
+    *choff = m->cell_choff;
+  }
+#else
+  if(m->r != 0 && link->cell_seq > 0) {
+    if(!m->cell_valid || m->cell_seq != link->cell_seq) {
+      m->cell_ts = m->ts;
+      m->cell_choff = m->choff;
+      IMP_CALLBACK_PACKET_SELECTION(&m->cell_ts, &m->cell_choff, *rx_lladdr, link->cell_seq);
+      m->cell_seq = link->cell_seq;
+      m->cell_valid = 1;
+    }
+    *ts = m->cell_ts;
+    *choff = m->cell_choff;
+  }
+#endif
+  return m->r;
+}
+#endif
+/*---------------------------------------------------------------------------*/
+/* Drop a packet from the slot operation: out of its ring, and to the
+ * dequeued ringbuf with MAC_TX_ERR, for tsch_tx_process_pending() to call
+ * its sent callback and free it. Runs before the TX slot reserves its own
+ * dequeued_ringbuf entry */
+static void
+tsch_queue_drop_packet(struct tsch_neighbor *n, int class, int offset)
+{
+  struct tsch_packet *p;
+  int16_t dequeued_index = ringbufindex_peek_put(&dequeued_ringbuf);
+  if(dequeued_index != -1) {
+    p = tsch_queue_remove_at(n, class, offset);
+    if(p != NULL) {
+      p->ret = MAC_TX_ERR;
+      dequeued_array[dequeued_index] = p;
+      ringbufindex_put(&dequeued_ringbuf);
+      tsch_queue_unschedulable_dropped++;
+      num_pktdrop_queue++;
+      process_poll(&tsch_pending_events_process);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* May packet p of neighbor n go out over link? Returns 1 if so, 0 if not,
+ * and -1 if p is to be dropped as there is no unicast link to its destination,
+ * see TSCH_QUEUE_UNSCHEDULABLE */
+static int
+tsch_queue_packet_fits_link(const struct tsch_neighbor *n, struct tsch_packet *p, struct tsch_link *link)
+{
 #if TSCH_WITH_LINK_SELECTOR
-//-------------------------------------------------------------------------------------------- 
+//--------------------------------------------------------------------------------------------
 // select packet by checking sfid, time_offset and channel_offset
-        int packet_attr_slotframe = queuebuf_attr(n->tx_array[get_index]->qb, PACKETBUF_ATTR_TSCH_SLOTFRAME);
-        int packet_attr_timeslot = queuebuf_attr(n->tx_array[get_index]->qb, PACKETBUF_ATTR_TSCH_TIMESLOT);
-        int packet_attr_channel_offset = queuebuf_attr(n->tx_array[get_index]->qb, PACKETBUF_ATTR_TSCH_CHANNEL_OFFSET);
-
+  int packet_attr_slotframe = queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_SLOTFRAME);
+  int packet_attr_timeslot = queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_TIMESLOT);
+  int packet_attr_channel_offset = queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_CHANNEL_OFFSET);
 
 #ifdef ALICE_CALLBACK_PACKET_SELECTION
-        if(packet_attr_slotframe == ALICE_UNICAST_SF_ID) {
-          linkaddr_t rx_lladdr;
-          linkaddr_copy(&rx_lladdr, queuebuf_addr(n->tx_array[get_index]->qb, PACKETBUF_ADDR_RECEIVER));
-           uint16_t packet_ts=-1;
-           uint16_t packet_choff=-1;
-
-           // this function calculates timeoffset and channeloffset on the basis of the link-level packet destiation (rx_lladdr) and the current ASFN.
-           int r=ALICE_CALLBACK_PACKET_SELECTION(&packet_ts, &packet_choff, rx_lladdr); //Decides packet_ts and packet_choff, checks rpl neighbor relations.
-          #if IMP_METHOD3
-          
-           if(r!=0 && link->schedule_num > 0) {
-              SPE_CALLBACK_PACKET_SELECTION(&packet_ts, &packet_choff, rx_lladdr, link->cell_seq, link->schedule_num);
-           }
-          #else 
-           if(r!=0 && link->cell_seq > 0) {
-              IMP_CALLBACK_PACKET_SELECTION(&packet_ts, &packet_choff, rx_lladdr, link->cell_seq);
-           }
-          #endif
-           if(r==0){ //no unicast link
-			tsch_queue_free_packet(n->tx_array[get_index]);
- 
-		return NULL;
-           }else{ // has unicast link
- 		   if(packet_attr_slotframe != 0xffff && link->slotframe_handle!= ALICE_UNICAST_SF_ID) {
-      
-	             return NULL;
-	           }
-	           if(packet_attr_timeslot != 0xffff && link->timeslot!= packet_ts) { //atria link selector calculated packet_ts at the current asfn.
-    
-	             return NULL;
-	           }
-	           if(link->channel_offset != packet_choff) { //atria link selector calculated packet_choff at the current asfn.
-     
-	             return NULL; 
-	           }
-	 }
-  
-
- 	 return n->tx_array[get_index];
-        }else{//ksh.. This is EB or RPL slotframe
-           if(packet_attr_slotframe != 0xffff && link->slotframe_handle!= packet_attr_slotframe) {
-    
-             return NULL;
-           }
-           if(packet_attr_timeslot != 0xffff && packet_attr_timeslot != link->timeslot) {
-    
-             return NULL;
-           }
-           if(packet_attr_channel_offset != link->channel_offset) { 
-  
-             return NULL; 
-           }
-	}
-#else //original source code
-        if(packet_attr_slotframe != 0xffff && link->slotframe_handle!= packet_attr_slotframe) {
-          return NULL;
-        }
-        if(packet_attr_timeslot != 0xffff && packet_attr_timeslot != link->timeslot) {
-          return NULL;
-        }
-        if(packet_attr_channel_offset != link->channel_offset) { 
-          return NULL; 
-        } 
+  if(packet_attr_slotframe == ALICE_UNICAST_SF_ID) {
+    linkaddr_t rx_lladdr;
+    uint16_t packet_ts;
+    uint16_t packet_choff;
+    linkaddr_copy(&rx_lladdr, queuebuf_addr(p->qb, PACKETBUF_ADDR_RECEIVER));
+
+    // this function calculates timeoffset and channeloffset on the basis of the link-level packet destiation (rx_lladdr) and the current ASFN.
+    int r=alice_packet_selection(n, &rx_lladdr, link, &packet_ts, &packet_choff);
+    if(r==0){ //no unicast link (yet), e.g. during a parent switch
+      if(!(p->unschedulable & TSCH_PACKET_UNSCHEDULABLE)) {
+        p->unschedulable = TSCH_PACKET_UNSCHEDULABLE;
+#if TSCH_QUEUE_UNSCHEDULABLE == TSCH_QUEUE_UNSCHEDULABLE_PARK
+        p->parked_asn = current_asn.ls4b;
+#endif
+        tsch_queue_unschedulable++;
+      }
+#if TSCH_QUEUE_UNSCHEDULABLE == TSCH_QUEUE_UNSCHEDULABLE_SHARED
+      if(link->slotframe_handle == ALICE_BROADCAST_SF_ID) {
+        p->unschedulable |= TSCH_PACKET_VIA_SHARED;
+        return 1;
+      }
+      return 0;
+#elif TSCH_QUEUE_UNSCHEDULABLE == TSCH_QUEUE_UNSCHEDULABLE_PARK
+      if((uint32_t)(current_asn.ls4b - p->parked_asn) < TSCH_QUEUE_PARK_TIMEOUT) {
+        return 0;
+      }
+      return -1;
+#else
+      return -1;
+#endif
+    }
+    // has unicast link
+    p->unschedulable &= ~TSCH_PACKET_VIA_SHARED;
+    if(link->slotframe_handle!= ALICE_UNICAST_SF_ID) {
+      return 0;
+    }
+    if(packet_attr_timeslot != 0xffff && link->timeslot!= packet_ts) { //atria link selector calculated packet_ts at the current asfn.
+      return 0;
+    }
+    if(link->channel_offset != packet_choff) { //atria link selector calculated packet_choff at the current asfn.
+      return 0;
+    }
+    return 1;
+  }
+  //ksh.. This is EB or RPL slotframe
 #endif //ALICE_CALLBACK_PACKET_SELECTION
+  if(packet_attr_slotframe != 0xffff && link->slotframe_handle!= packet_attr_slotframe) {
+    return 0;
+  }
+  if(packet_attr_timeslot != 0xffff && packet_attr_timeslot != link->timeslot) {
+    return 0;
+  }
+  if(packet_attr_channel_offset != link->channel_offset) {
+    return 0;
+  }
 #endif //TSCH_WITH_LINK_SELECTOR
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+#if TSCH_QUEUE_LOOKAHEAD > 1
+/* May two packets of a neighbor queue go out over the same cells? Packets of
+ * the ATRIA unicast slotframe share all the cells to their neighbor, others
+ * are bound by their slotframe, timeslot and channel offset, 0xffff for any */
+static int
+tsch_queue_same_cell(struct tsch_packet *p, struct tsch_packet *q)
+{
+#if TSCH_WITH_LINK_SELECTOR
+  int slotframe = queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_SLOTFRAME);
+  int q_slotframe = queuebuf_attr(q->qb, PACKETBUF_ATTR_TSCH_SLOTFRAME);
+  int timeslot = queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_TIMESLOT);
+  int q_timeslot = queuebuf_attr(q->qb, PACKETBUF_ATTR_TSCH_TIMESLOT);
 
-        return n->tx_array[get_index];
+  if(slotframe != q_slotframe && slotframe != 0xffff && q_slotframe != 0xffff) {
+    return 0;
+  }
+#ifdef ALICE_CALLBACK_PACKET_SELECTION
+  if(slotframe == ALICE_UNICAST_SF_ID) {
+    return 1;
+  }
+#endif
+  if(timeslot != q_timeslot && timeslot != 0xffff && q_timeslot != 0xffff) {
+    return 0;
+  }
+  return queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_CHANNEL_OFFSET)
+         == queuebuf_attr(q->qb, PACKETBUF_ATTR_TSCH_CHANNEL_OFFSET);
+#else
+  return 1;
+#endif
+}
+#endif
+/*---------------------------------------------------------------------------*/
+/* Returns the first packet from a neighbor queue that may go out over link:
+ * the head of the class picked by the policy or, with TSCH_QUEUE_LOOKAHEAD,
+ * the first of the packets looked at that fits and overtakes no packet bound
+ * for the same cells */
+struct tsch_packet *
+tsch_queue_get_packet_for_nbr(struct tsch_neighbor *n, struct tsch_link *link)
+{
+  if(!tsch_is_locked()) {
+    int is_shared_link = link != NULL && link->link_options & LINK_OPTION_SHARED;
+    if(n != NULL && !(is_shared_link && !tsch_queue_backoff_expired(n))) { /* If this is a shared link,
+                                                                          make sure the backoff has expired */
+      int first = tsch_queue_select_class(n);
+      int i, class, offset, elements, fits;
+      int16_t get_index;
+      struct tsch_packet *p;
+#if TSCH_QUEUE_LOOKAHEAD > 1
+      /* The packets passed over, still waiting for their cells */
+      struct tsch_packet *waiting[TSCH_QUEUE_NUM_CLASSES * TSCH_QUEUE_LOOKAHEAD];
+      int num_waiting = 0, j;
+#endif
+
+      /* The policy's class, then the others by priority */
+      for(i = 0; first != -1 && i < (TSCH_QUEUE_LOOKAHEAD > 1 ? TSCH_QUEUE_NUM_CLASSES : 1); i++) {
+        class = i == 0 ? first : (i - 1 < first ? i - 1 : i);
+        get_index = ringbufindex_peek_get(&n->tx_ringbuf[class]);
+        elements = ringbufindex_elements(&n->tx_ringbuf[class]);
+        for(offset = 0; get_index != -1 && offset < MIN(elements, TSCH_QUEUE_LOOKAHEAD); offset++) {
+          p = n->tx_array[class][(get_index + offset) & (TSCH_QUEUE_NUM_PER_CLASS - 1)];
+          fits = tsch_queue_packet_fits_link(n, p, link);
+          if(fits < 0) {
+            tsch_queue_drop_packet(n, class, offset);
+            return NULL;
+          }
+#if TSCH_QUEUE_LOOKAHEAD > 1
+          /* Same cells, same order: never ahead of a packet that waits for them */
+          for(j = 0; fits && j < num_waiting; j++) {
+            fits = !tsch_queue_same_cell(p, waiting[j]);
+          }
+          waiting[num_waiting++] = p;
+#endif
+          if(fits) {
+            TSCH_QUEUE_SET_PEEKED(n, class, offset);
+            return p;
+          }
+        }
       }
     }
   }
@@ -472,25 +1117,39 @@ tsch_queue_get_packet_for_dest_addr(const linkaddr_t *addr, struct tsch_link *li
 }
 /*---------------------------------------------------------------------------*/
 /* Returns the head packet of any neighbor queue with zero backoff counter.
- * Writes pointer to the neighbor in *n */
+ * Writes pointer to the neighbor in *n. Only neighbors of the ready list are
+ * looked at, starting after the one that got the previous packet */
 struct tsch_packet *
 tsch_queue_get_unicast_packet_for_any(struct tsch_neighbor **n, struct tsch_link *link)
 {
   if(!tsch_is_locked()) {
-    struct tsch_neighbor *curr_nbr = list_head(neighbor_list);
+    struct tsch_neighbor *neighbors = (struct tsch_neighbor *)neighbor_memb.mem;
+    struct tsch_neighbor *curr_nbr;
     struct tsch_packet *p = NULL;
-    while(curr_nbr != NULL) {
-      if(!curr_nbr->is_broadcast && curr_nbr->tx_links_count == 0) {
-        /* Only look up for non-broadcast neighbors we do not have a tx link to */
+    uint8_t prev, i, left;
+
+    tsch_queue_ready_update();
+    prev = ready_tail;
+    for(left = ready_count; left > 0; left--) {
+      i = ready_next[prev];
+      curr_nbr = &neighbors[i];
+      if(tsch_queue_is_empty(curr_nbr)) {
+        tsch_queue_ready_unlink(prev, i);
+        continue;
+      }
+      if(curr_nbr->tx_links_count == 0) {
+        /* Only look up for neighbors we do not have a tx link to */
         p = tsch_queue_get_packet_for_nbr(curr_nbr, link);
         if(p != NULL) {
           if(n != NULL) {
             *n = curr_nbr;
           }
+          /* Round robin: the next search starts after this neighbor */
+          ready_tail = i;
           return p;
         }
       }
-      curr_nbr = list_item_next(curr_nbr);
+      prev = i;
     }
   }
   return NULL;
@@ -515,6 +1174,8 @@ tsch_queue_backoff_reset(struct tsch_neighbor *n)
 void
 tsch_queue_backoff_inc(struct tsch_neighbor *n)
 {
+  int i;
+
   /* Increment exponent */
   n->backoff_exponent = MIN(n->backoff_exponent + 1, TSCH_MAC_MAX_BE);
   /* Pick a window (number of shared slots to skip). Ignore least significant
@@ -524,22 +1185,45 @@ tsch_queue_backoff_inc(struct tsch_neighbor *n)
   /* Add one to the window as we will decrement it at the end of the current slot
    * through tsch_queue_update_all_backoff_windows */
   n->backoff_window++;
+  i = n - (struct tsch_neighbor *)neighbor_memb.mem;
+  backoff_bitmap[i / 32] |= (uint32_t)1 << (i % 32);
 }
 /*---------------------------------------------------------------------------*/
-/* Decrement backoff window for all queues directed at dest_addr */
+/* Decrement backoff window for all queues directed at dest_addr. Only the
+ * neighbors of backoff_bitmap are visited, none in the common case. */
 void
 tsch_queue_update_all_backoff_windows(const linkaddr_t *dest_addr)
 {
   if(!tsch_is_locked()) {
-    int is_broadcast = linkaddr_cmp(dest_addr, &tsch_broadcast_address);
-    struct tsch_neighbor *n = list_head(neighbor_list);
-    while(n != NULL) {
-      if(n->backoff_window != 0 /* Is the queue in backoff state? */
-         && ((n->tx_links_count == 0 && is_broadcast)
-             || (n->tx_links_count > 0 && linkaddr_cmp(dest_addr, &n->addr)))) {
-        n->backoff_window--;	
+    struct tsch_neighbor *neighbors = (struct tsch_neighbor *)neighbor_memb.mem;
+    struct tsch_neighbor *n;
+    int is_broadcast = -1;
+    uint32_t bits;
+    int w, i;
+
+    for(w = 0; w < BACKOFF_BITMAP_WORDS; w++) {
+      for(bits = backoff_bitmap[w], i = w * 32; bits != 0; bits >>= 1, i++) {
+        if(!(bits & 1)) {
+          continue;
+        }
+        n = &neighbors[i];
+        if(!neighbor_memb.count[i] || n->backoff_window == 0) {
+          /* Freed or reset since its backoff_inc */
+          backoff_bitmap[w] &= ~((uint32_t)1 << (i % 32));
+          continue;
+        }
+        if(is_broadcast == -1) {
+          is_broadcast = linkaddr_cmp(dest_addr, &tsch_broadcast_address);
+        }
+        /* Dedicated links or not is checked per neighbor, as tx_links_count
+         * follows the schedule */
+        if((n->tx_links_count == 0 && is_broadcast)
+           || (n->tx_links_count > 0 && linkaddr_cmp(dest_addr, &n->addr))) {
+          if(--n->backoff_window == 0) {
+            backoff_bitmap[w] &= ~((uint32_t)1 << (i % 32));
+          }
+        }
       }
-      n = list_item_next(n);
     }
   }
 }
@@ -551,6 +1235,13 @@ tsch_queue_init(void)
   list_init(neighbor_list);
   memb_init(&neighbor_memb);
   memb_init(&packet_memb);
+  ready_tail = READY_NONE;
+  ready_count = 0;
+  memset(ready_state, READY_UNLINKED, sizeof(ready_state));
+  ringbufindex_init(&ready_wakeup_ringbuf, TSCH_DEQUEUED_ARRAY_SIZE);
+#if TSCH_QUEUE_WITH_NBR_HASH
+  memset(nbr_hash, NBR_HASH_EMPTY, sizeof(nbr_hash));
+#endif
   /* Add virtual EB and the broadcast neighbors */
   n_eb = tsch_queue_add_nbr(&tsch_eb_address);
   n_broadcast = tsch_queue_add_nbr(&tsch_broadcast_address);
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2014, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+#ifndef __TSCH_QUEUE_H__
+#define __TSCH_QUEUE_H__
+
+/********** Includes **********/
+
+#include "contiki.h"
+#include "lib/ringbufindex.h"
+#include "net/linkaddr.h"
+#include "net/mac/tsch/tsch-asn.h"
+#include "net/mac/mac.h"
+
+/******** Configuration *******/
+
+/* The maximum number of outgoing packets towards each neighbor
+ * Must be power of two to enable atomic ringbuf operations.
+ * Note: the total number of outgoing packets in the system (for
+ * all neighbors) is defined via QUEUEBUF_CONF_NUM */
+#ifdef TSCH_QUEUE_CONF_NUM_PER_NEIGHBOR
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR TSCH_QUEUE_CONF_NUM_PER_NEIGHBOR
+#else
+/* By default, round QUEUEBUF_CONF_NUM to next power of two
+ * (in the range [4;256]) */
+#if QUEUEBUF_CONF_NUM <= 4
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR 4
+#elif QUEUEBUF_CONF_NUM <= 8
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR 8
+#elif QUEUEBUF_CONF_NUM <= 16
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR 16
+#elif QUEUEBUF_CONF_NUM <= 32
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR 32
+#elif QUEUEBUF_CONF_NUM <= 64
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR 64
+#elif QUEUEBUF_CONF_NUM <= 128
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR 128
+#else
+#define TSCH_QUEUE_NUM_PER_NEIGHBOR 256
+#endif
+#endif
+
+/* The number of neighbor queues. There are two queues allocated at all times:
+ * one for EBs, one for broadcasts. Other queues are for unicast to neighbors */
+#ifdef TSCH_QUEUE_CONF_MAX_NEIGHBOR_QUEUES
+#define TSCH_QUEUE_MAX_NEIGHBOR_QUEUES TSCH_QUEUE_CONF_MAX_NEIGHBOR_QUEUES
+#else
+#define TSCH_QUEUE_MAX_NEIGHBOR_QUEUES ((NBR_TABLE_CONF_MAX_NEIGHBORS) + 2)
+#endif
+
+/* tsch_queue_get_nbr looks neighbors up in an open-addressing hash index of
+ * their link address, at most half full, instead of walking the list. 0 for
+ * the list walk only */
+#ifdef TSCH_QUEUE_CONF_WITH_NBR_HASH
+#define TSCH_QUEUE_WITH_NBR_HASH TSCH_QUEUE_CONF_WITH_NBR_HASH
+#else
+#define TSCH_QUEUE_WITH_NBR_HASH 1
+#endif
+
+/* Size of the neighbor hash index, a power of two */
+#if TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 8
+#define TSCH_QUEUE_NBR_HASH_BITS 4
+#elif TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 16
+#define TSCH_QUEUE_NBR_HASH_BITS 5
+#elif TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 32
+#define TSCH_QUEUE_NBR_HASH_BITS 6
+#elif TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 64
+#define TSCH_QUEUE_NBR_HASH_BITS 7
+#elif TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 128
+#define TSCH_QUEUE_NBR_HASH_BITS 8
+#else
+#define TSCH_QUEUE_NBR_HASH_BITS 9
+#endif
+#define TSCH_QUEUE_NBR_HASH_SIZE (1 << TSCH_QUEUE_NBR_HASH_BITS)
+
+/* Priority classes of the packets towards a neighbor, highest first */
+#define TSCH_QUEUE_CLASS_CONTROL 0 /* EBs and ICMPv6 (RPL) */
+#define TSCH_QUEUE_CLASS_LATENCY 1 /* Latency-critical data */
+#define TSCH_QUEUE_CLASS_BULK    2 /* Other data */
+
+/* The number of priority classes per neighbor, each with its own ringbuf.
+ * With fewer classes than above, the lowest ones are merged. 1: stock queue */
+#ifdef TSCH_QUEUE_CONF_NUM_CLASSES
+#define TSCH_QUEUE_NUM_CLASSES TSCH_QUEUE_CONF_NUM_CLASSES
+#else
+#define TSCH_QUEUE_NUM_CLASSES 1
+#endif
+
+/* The maximum number of packets of one class towards a neighbor.
+ * Power of two, as TSCH_QUEUE_NUM_PER_NEIGHBOR */
+#ifdef TSCH_QUEUE_CONF_NUM_PER_CLASS
+#define TSCH_QUEUE_NUM_PER_CLASS TSCH_QUEUE_CONF_NUM_PER_CLASS
+#else
+#define TSCH_QUEUE_NUM_PER_CLASS TSCH_QUEUE_NUM_PER_NEIGHBOR
+#endif
+
+/* Dequeue policy across classes: strict priority, or weighted round robin
+ * with TSCH_QUEUE_CLASS_WEIGHTS packets per class and round */
+#define TSCH_QUEUE_POLICY_STRICT   0
+#define TSCH_QUEUE_POLICY_WEIGHTED 1
+
+#ifdef TSCH_QUEUE_CONF_POLICY
+#define TSCH_QUEUE_POLICY TSCH_QUEUE_CONF_POLICY
+#else
+#define TSCH_QUEUE_POLICY TSCH_QUEUE_POLICY_STRICT
+#endif
+
+#ifdef TSCH_QUEUE_CONF_CLASS_WEIGHTS
+#define TSCH_QUEUE_CLASS_WEIGHTS TSCH_QUEUE_CONF_CLASS_WEIGHTS
+#else
+#define TSCH_QUEUE_CLASS_WEIGHTS { 4, 2, 1 }
+#endif
+
+/* The number of packets of each class ring examined for the current link.
+ * 1: the head only, as stock TSCH. Above, a packet may overtake the packets
+ * ahead of it that are bound for other cells, e.g. those of another
+ * slotframe, and classes other than the policy's are tried as well. Packets
+ * to a neighbor bound for the same cells, as all those of the ATRIA unicast
+ * slotframe, keep their order */
+#ifdef TSCH_QUEUE_CONF_LOOKAHEAD
+#define TSCH_QUEUE_LOOKAHEAD TSCH_QUEUE_CONF_LOOKAHEAD
+#else
+#define TSCH_QUEUE_LOOKAHEAD 1
+#endif
+
+/* The QUEUEBUF_NUM packets are a pool shared by all neighbors. A neighbor holds
+ * at most TSCH_QUEUE_NBR_MAX_PACKETS of them, and TSCH_QUEUE_NBR_MIN_PACKETS
+ * are reserved for it: when the pool is full, TSCH_QUEUE_EVICTION decides
+ * whether a neighbor may reclaim a packet slot from another one.
+ * tsch_queue_set_nbr_quota() overrides both for a given neighbor. */
+#ifdef TSCH_QUEUE_CONF_NBR_MIN_PACKETS
+#define TSCH_QUEUE_NBR_MIN_PACKETS TSCH_QUEUE_CONF_NBR_MIN_PACKETS
+#else
+#define TSCH_QUEUE_NBR_MIN_PACKETS 0
+#endif
+
+#ifdef TSCH_QUEUE_CONF_NBR_MAX_PACKETS
+#define TSCH_QUEUE_NBR_MAX_PACKETS TSCH_QUEUE_CONF_NBR_MAX_PACKETS
+#else
+#define TSCH_QUEUE_NBR_MAX_PACKETS 255 /* No cap but the ringbufs */
+#endif
+
+/* Eviction policy when the pool is full */
+#define TSCH_QUEUE_EVICT_NONE    0 /* Drop the new packet */
+#define TSCH_QUEUE_EVICT_LONGEST 1 /* Drop the newest, lowest-class packet of the
+                                    * unicast neighbor furthest above its
+                                    * reservation, if the new packet's neighbor
+                                    * is below its own or at least two packets
+                                    * less above it. Never a packet of a higher
+                                    * priority than the new one */
+
+#ifdef TSCH_QUEUE_CONF_EVICTION
+#define TSCH_QUEUE_EVICTION TSCH_QUEUE_CONF_EVICTION
+#else
+#define TSCH_QUEUE_EVICTION TSCH_QUEUE_EVICT_NONE
+#endif
+
+/* What to do with a packet of the ATRIA unicast slotframe with no unicast
+ * link to its destination (ALICE_CALLBACK_PACKET_SELECTION returns 0), as
+ * happens during parent switches and DAO propagation */
+#define TSCH_QUEUE_UNSCHEDULABLE_DROP   0 /* Drop it */
+#define TSCH_QUEUE_UNSCHEDULABLE_SHARED 1 /* Send it over the shared slotframe
+                                           * (ALICE_BROADCAST_SF_ID) until the
+                                           * unicast link appears */
+#define TSCH_QUEUE_UNSCHEDULABLE_PARK   2 /* Keep it queued until the unicast link
+                                           * appears, for TSCH_QUEUE_PARK_TIMEOUT
+                                           * slots at most, then drop it */
+
+#ifdef TSCH_QUEUE_CONF_UNSCHEDULABLE
+#define TSCH_QUEUE_UNSCHEDULABLE TSCH_QUEUE_CONF_UNSCHEDULABLE
+#else
+#define TSCH_QUEUE_UNSCHEDULABLE TSCH_QUEUE_UNSCHEDULABLE_DROP
+#endif
+
+#ifdef TSCH_QUEUE_CONF_PARK_TIMEOUT
+#define TSCH_QUEUE_PARK_TIMEOUT TSCH_QUEUE_CONF_PARK_TIMEOUT
+#else
+#define TSCH_QUEUE_PARK_TIMEOUT 1000
+#endif
+
+/* TSCH CSMA-CA parameters, see IEEE 802.15.4e-2012 */
+/* Min backoff exponent */
+#ifdef TSCH_CONF_MAC_MIN_BE
+#define TSCH_MAC_MIN_BE TSCH_CONF_MAC_MIN_BE
+#else
+#define TSCH_MAC_MIN_BE 1
+#endif
+
+/* Max backoff exponent */
+#ifdef TSCH_CONF_MAC_MAX_BE
+#define TSCH_MAC_MAX_BE TSCH_CONF_MAC_MAX_BE
+#else
+#define TSCH_MAC_MAX_BE 7
+#endif
+
+/* Max number of re-transmissions */
+#ifdef TSCH_CONF_MAC_MAX_FRAME_RETRIES
+#define TSCH_MAC_MAX_FRAME_RETRIES TSCH_CONF_MAC_MAX_FRAME_RETRIES
+#else
+#define TSCH_MAC_MAX_FRAME_RETRIES 7
+#endif
+
+/* Called at every time source change */
+#ifdef TSCH_CALLBACK_NEW_TIME_SOURCE
+struct tsch_neighbor;
+void TSCH_CALLBACK_NEW_TIME_SOURCE(const struct tsch_neighbor *old, const struct tsch_neighbor *new);
+#endif
+
+/* Called by TSCH every time a packet is ready to be added to the send queue */
+#ifdef TSCH_CALLBACK_PACKET_READY
+void TSCH_CALLBACK_PACKET_READY(void);
+#endif
+
+/* Called on every enqueue to pick the class of the packet in packetbuf.
+ * Returns a TSCH_QUEUE_CLASS_*, or -1 for the default classification */
+#ifdef TSCH_CALLBACK_PACKET_CLASS
+int TSCH_CALLBACK_PACKET_CLASS(void);
+#endif
+
+/************ Types ***********/
+
+/* TSCH packet information */
+struct tsch_packet {
+  struct queuebuf *qb;  /* pointer to the queuebuf to be sent */
+  mac_callback_t sent; /* callback for this packet */
+  void *ptr; /* MAC callback parameter */
+  uint8_t transmissions; /* #transmissions performed for this packet */
+  uint8_t ret; /* status -- MAC return code */
+  uint8_t header_len; /* length of header and header IEs (needed for link-layer security) */
+  uint8_t tsch_sync_ie_offset; /* Offset within the frame used for quick update of EB ASN and join priority */
+  uint8_t unschedulable; /* TSCH_PACKET_* flags, see TSCH_QUEUE_UNSCHEDULABLE */
+#if TSCH_QUEUE_UNSCHEDULABLE == TSCH_QUEUE_UNSCHEDULABLE_PARK
+  uint32_t parked_asn; /* Since when it has no unicast link (ASN, 4 lsb) */
+#endif
+};
+
+/* tsch_packet unschedulable flags */
+#define TSCH_PACKET_UNSCHEDULABLE 0x01 /* Had no unicast link at some point */
+#define TSCH_PACKET_VIA_SHARED    0x02 /* Last peeked for the shared slotframe */
+
+/* TSCH neighbor information */
+struct tsch_neighbor {
+  /* Neighbors are stored as a list: "next" must be the first field */
+  struct tsch_neighbor *next;
+  linkaddr_t addr; /* MAC address of the neighbor */
+  uint8_t is_broadcast; /* is this neighbor a virtual neighbor used for broadcast (of data packets or EBs) */
+  uint8_t is_time_source; /* is this neighbor a time source? */
+  uint8_t backoff_exponent; /* CSMA backoff exponent */
+  uint8_t backoff_window; /* CSMA backoff window (number of slots to skip) */
+  uint8_t last_backoff_window; /* Last CSMA backoff window */
+  uint8_t tx_links_count; /* How many links do we have to this neighbor? */
+  uint8_t dedicated_tx_links_count; /* How many dedicated links do we have to this neighbor? */
+  uint8_t min_packets; /* Packets of the pool reserved for this neighbor */
+  uint8_t max_packets; /* Max packets of the pool this neighbor may hold */
+  /* Array for the ringbuf of each class. Contains pointers to packets.
+   * Its size must be a power of two to allow for atomic put */
+  struct tsch_packet *tx_array[TSCH_QUEUE_NUM_CLASSES][TSCH_QUEUE_NUM_PER_CLASS];
+  /* Circular buffer of pointers to packet, one per class. */
+  struct ringbufindex tx_ringbuf[TSCH_QUEUE_NUM_CLASSES];
+#if TSCH_QUEUE_NUM_CLASSES > 1 && TSCH_QUEUE_POLICY == TSCH_QUEUE_POLICY_WEIGHTED
+  /* Packets each class may still send in the current round */
+  uint8_t tx_credit[TSCH_QUEUE_NUM_CLASSES];
+#endif
+};
+
+struct tsch_link;
+
+/***** External Variables *****/
+
+/* Broadcast and EB virtual neighbors */
+extern struct tsch_neighbor *n_broadcast;
+extern struct tsch_neighbor *n_eb;
+/* Enqueue failures per class */
+extern uint16_t tsch_queue_class_overflow[TSCH_QUEUE_NUM_CLASSES];
+/* Packets dropped to make room for another neighbor's */
+extern uint16_t tsch_queue_evicted;
+/* Packets without a unicast link to their destination, and of them, the ones
+ * acked over the shared slotframe, acked over a unicast link that appeared
+ * later, and dropped */
+extern uint16_t tsch_queue_unschedulable;
+extern uint16_t tsch_queue_unschedulable_shared;
+extern uint16_t tsch_queue_unschedulable_late;
+extern uint16_t tsch_queue_unschedulable_dropped;
+
+/********** Functions *********/
+
+/* Add a TSCH neighbor */
+struct tsch_neighbor *tsch_queue_add_nbr(const linkaddr_t *addr);
+/* Get a TSCH neighbor */
+struct tsch_neighbor *tsch_queue_get_nbr(const linkaddr_t *addr);
+/* Index of a TSCH neighbor, 0..TSCH_QUEUE_MAX_NEIGHBOR_QUEUES-1, reused once it is removed */
+int tsch_queue_nbr_index(const struct tsch_neighbor *n);
+/* Get a TSCH time source (we currently assume there is only one) */
+struct tsch_neighbor *tsch_queue_get_time_source(void);
+/* Update TSCH time source */
+int tsch_queue_update_time_source(const linkaddr_t *new_addr);
+/* Add packet to neighbor queue. Use same lockfree implementation as ringbuf.c (put is atomic) */
+struct tsch_packet *tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr);
+/* Returns the number of packets currently in the queue */
+int tsch_queue_packet_count(const linkaddr_t *addr);
+/* Returns the number of packets of a class currently in the queue */
+int tsch_queue_class_packet_count(const linkaddr_t *addr, uint8_t class);
+/* Set the share of the packet pool of a neighbor. Returns 0 on failure */
+int tsch_queue_set_nbr_quota(const linkaddr_t *addr, uint8_t min_packets, uint8_t max_packets);
+/* Remove first packet from a neighbor queue. The packet is stored in a separate
+ * dequeued packet list, for later processing. Return the packet. */
+struct tsch_packet *tsch_queue_remove_packet_from_queue(struct tsch_neighbor *n);
+/* Free a packet */
+void tsch_queue_free_packet(struct tsch_packet *p);
+/* Flush all neighbor queues */
+void tsch_queue_reset(void);
+/* Deallocate neighbors with empty queue */
+void tsch_queue_free_unused_neighbors(void);
+/* Is the neighbor queue empty? */
+int tsch_queue_is_empty(const struct tsch_neighbor *n);
+/* Returns the first packet from a neighbor queue */
+struct tsch_packet *tsch_queue_get_packet_for_nbr(struct tsch_neighbor *n, struct tsch_link *link);
+/* Returns the head packet from a neighbor queue (from neighbor address) */
+struct tsch_packet *tsch_queue_get_packet_for_dest_addr(const linkaddr_t *addr, struct tsch_link *link);
+/* Returns the head packet of any neighbor queue with zero backoff counter.
+ * Writes pointer to the neighbor in *n */
+struct tsch_packet *tsch_queue_get_unicast_packet_for_any(struct tsch_neighbor **n, struct tsch_link *link);
+/* May the neighbor transmit over a share link? */
+int tsch_queue_backoff_expired(const struct tsch_neighbor *n);
+/* Reset neighbor backoff */
+void tsch_queue_backoff_reset(struct tsch_neighbor *n);
+/* Increment backoff exponent, pick a new window */
+void tsch_queue_backoff_inc(struct tsch_neighbor *n);
+/* Decrement backoff window for all queues directed at dest_addr */
+void tsch_queue_update_all_backoff_windows(const linkaddr_t *dest_addr);
+/* Initialize TSCH queue module */
+void tsch_queue_init(void);
+
+#endif /* __TSCH_QUEUE_H__ */
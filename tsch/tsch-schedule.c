@@ -72,11 +72,6 @@
 #define DEBUG DEBUG_NONE
 #include "net/net-debug.h"
 */
-// atria time varying scheduling ----------------------------//
-#ifdef ALICE_TSCH_CALLBACK_SLOTFRAME_START 
-   void ALICE_TSCH_CALLBACK_SLOTFRAME_START(uint16_t sfid, uint16_t sfsize); 
-#endif 
-
 /* Pre-allocated space for links */
 MEMB(link_memb, struct tsch_link, TSCH_SCHEDULE_MAX_LINKS);
 /* Pre-allocated space for slotframes */
@@ -84,6 +79,65 @@ MEMB(slotframe_memb, struct tsch_slotframe, TSCH_SCHEDULE_MAX_SLOTFRAMES);
 /* List of slotframes (each slotframe holds its own list of links) */
 LIST(slotframe_list);
 
+/* The links of all slotframes as indices in link_memb, sorted by timeslot
+ * within each slotframe and in list order within a timeslot. Each slotframe
+ * owns the segment [index_start, index_start + index_len). The index is
+ * rebuilt by the next tsch_schedule_get_next_active_link() after any change,
+ * but for links rewritten in place and handed over in order through
+ * tsch_schedule_links_sorted(). */
+#if TSCH_SCHEDULE_MAX_LINKS <= 256
+typedef uint8_t link_index_t;
+#else
+typedef uint16_t link_index_t;
+#endif
+static link_index_t link_index[TSCH_SCHEDULE_MAX_LINKS];
+static link_index_t link_index_tmp[TSCH_SCHEDULE_MAX_LINKS];
+static volatile uint8_t link_index_dirty = 1;
+/* While the index is dirty: the one slotframe whose links were rewritten in
+ * place since it was sorted, NULL after any other change */
+static struct tsch_slotframe *volatile link_index_rewritten;
+
+#define INDEX_LINK(i) ((struct tsch_link *)link_memb.mem + link_index[i])
+
+#if TSCH_SCHEDULE_WITH_CELL_STATS
+/* Statistics by direction and position, kept across link removals */
+static struct tsch_cell_stats cell_stats[TSCH_CELL_STATS_NUM_DIRS][TSCH_SCHEDULE_CELL_STATS_POSITIONS];
+#endif
+
+#if TSCH_SCHEDULE_LOOKAHEAD
+/* The next active links, computed ahead by tsch_schedule_lookahead_process
+ * and taken by the slot operation. An entry holds for the ASN it was searched
+ * from, as long as the schedule has not changed since: every change bumps
+ * schedule_generation before it touches the schedule, under the TSCH lock,
+ * and no entry is taken while the lock is held */
+struct lookahead_entry {
+  struct asn_t asn; /* Search start */
+  struct tsch_link *link;
+  struct tsch_link *backup_link;
+  uint16_t time_offset;
+  uint16_t generation;
+};
+static struct ringbufindex lookahead_ringbuf;
+static struct lookahead_entry lookahead_array[TSCH_SCHEDULE_LOOKAHEAD];
+static volatile uint16_t schedule_generation;
+PROCESS(tsch_schedule_lookahead_process, "TSCH schedule lookahead process");
+
+#if (TSCH_SCHEDULE_LOOKAHEAD & (TSCH_SCHEDULE_LOOKAHEAD - 1)) != 0
+#error TSCH_SCHEDULE_LOOKAHEAD must be power of two
+#endif
+
+#define SCHEDULE_CHANGED() do { \
+    link_index_dirty = 1; \
+    link_index_rewritten = NULL; \
+    schedule_generation++; \
+  } while(0)
+#else
+#define SCHEDULE_CHANGED() do { \
+    link_index_dirty = 1; \
+    link_index_rewritten = NULL; \
+  } while(0)
+#endif
+
 /* Adds and returns a slotframe (NULL if failure) */
 struct tsch_slotframe *
 tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
@@ -98,12 +152,18 @@ tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
   }
 
   if(tsch_get_lock()) {
-    struct tsch_slotframe *sf = memb_alloc(&slotframe_memb);
+    struct tsch_slotframe *sf;
+    SCHEDULE_CHANGED();
+    sf = memb_alloc(&slotframe_memb);
     if(sf != NULL) {
       /* Initialize the slotframe */
       sf->handle = handle;
       ASN_DIVISOR_INIT(sf->size, size);
       LIST_STRUCT_INIT(sf, links_list);
+      sf->index_start = 0;
+      sf->index_len = 0;
+      sf->start_callback = NULL;
+      sf->start_announced = 0;
       /* Add the slotframe to the global list */
       list_add(slotframe_list, sf);
     }
@@ -115,9 +175,10 @@ tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+#if TSCH_CELL_HASH == TSCH_CELL_HASH_WANG
 // Thomas Wang  32bit-Interger Mix Function
 uint16_t
-real_hash(uint16_t value, uint16_t mod){ //Thomas Wang method..
+real_hash_mix(uint16_t value){ //Thomas Wang method..
 
   uint32_t input=(uint32_t)value;
   uint32_t a=input;//|(input<<16);
@@ -129,7 +190,56 @@ real_hash(uint16_t value, uint16_t mod){ //Thomas Wang method..
   a = a ^ (a >> 15);
   
 //  a=a^(a>>16);
-  return (uint16_t)a%mod;
+  return (uint16_t)a;
+}
+#elif TSCH_CELL_HASH == TSCH_CELL_HASH_MURMUR3
+// MurmurHash3 fmix32, the upper half folded in instead of truncated
+uint16_t
+real_hash_mix(uint16_t value){
+  uint32_t a = value;
+
+  a ^= a >> 16;
+  a *= 0x85ebca6b;
+  a ^= a >> 13;
+  a *= 0xc2b2ae35;
+  a ^= a >> 16;
+  return (uint16_t)(a ^ (a >> 16));
+}
+#elif TSCH_CELL_HASH == TSCH_CELL_HASH_XORSHIFT
+// 16-bit xorshift-multiply, no 32-bit multiplication on 16-bit MCUs
+uint16_t
+real_hash_mix(uint16_t value){
+  uint16_t a = value;
+
+  a ^= a >> 8;
+  a *= 0x88b5u;
+  a ^= a >> 7;
+  a *= 0xdb2du;
+  a ^= a >> 9;
+  return a;
+}
+#else
+#error "Unknown TSCH_CELL_HASH"
+#endif
+/*---------------------------------------------------------------------------*/
+uint16_t
+real_hash_mod(uint16_t hash, uint16_t mod){
+#if TSCH_CELL_HASH_UNBIASED
+  /* Values from the last, incomplete run of mod residues are rehashed.
+   * Bounded, a value left over after that keeps its small bias. */
+  uint32_t limit = 65536UL - (65536UL % mod);
+  uint8_t i;
+
+  for(i = 0; i < 4 && hash >= limit; i++) {
+    hash = real_hash_mix(hash);
+  }
+#endif
+  return hash % mod;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+real_hash(uint16_t value, uint16_t mod){
+  return real_hash_mod(real_hash_mix(value), mod);
 }
 /*---------------------------------------------------------------------------*/
 //atria remove link by timeslot and channel offset
@@ -185,6 +295,7 @@ tsch_schedule_remove_slotframe(struct tsch_slotframe *slotframe)
 
     /* Now that the slotframe has no links, remove it. */
     if(tsch_get_lock()) {
+      SCHEDULE_CHANGED();
       PRINTF("TSCH-schedule: remove slotframe %u %u\n", slotframe->handle, slotframe->size.val);
       memb_free(&slotframe_memb, slotframe);
       list_remove(slotframe_list, slotframe);
@@ -277,6 +388,7 @@ tsch_schedule_add_link(struct tsch_slotframe *slotframe,
     if(!tsch_get_lock()) {
       PRINTF("TSCH-schedule:! add_link memb_alloc couldn't take lock\n");
     } else {
+      SCHEDULE_CHANGED();
       l = memb_alloc(&link_memb);
       if(l == NULL) {
         PRINTF("TSCH-schedule:! add_link memb_alloc failed\n");
@@ -350,6 +462,7 @@ tsch_schedule_add_first_link(struct tsch_slotframe *slotframe,
     if(!tsch_get_lock()) {
       PRINTF("TSCH-schedule:! add_link memb_alloc couldn't take lock\n");
     } else {
+      SCHEDULE_CHANGED();
       l = memb_alloc(&link_memb);
       if(l == NULL) {
         PRINTF("TSCH-schedule:! add_link memb_alloc failed\n");
@@ -423,6 +536,7 @@ tsch_schedule_add_multiple_link(struct tsch_slotframe *slotframe,
     if(!tsch_get_lock()) {
       PRINTF("TSCH-schedule:! add_link memb_alloc couldn't take lock\n");
     } else {
+      SCHEDULE_CHANGED();
       l = memb_alloc(&link_memb);
       if(l == NULL) {
         PRINTF("TSCH-schedule:! add_link memb_alloc failed\n");
@@ -495,6 +609,7 @@ tsch_schedule_add_evenly_link(struct tsch_slotframe *slotframe,
     if(!tsch_get_lock()) {
       PRINTF("TSCH-schedule:! add_link memb_alloc couldn't take lock\n");
     } else {
+      SCHEDULE_CHANGED();
       l = memb_alloc(&link_memb);
       if(l == NULL) {
         PRINTF("TSCH-schedule:! add_link memb_alloc failed\n");
@@ -552,6 +667,8 @@ tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l)
       uint8_t link_options;
       linkaddr_t addr;
 
+      SCHEDULE_CHANGED();
+
       /* Save link option and addr in local variables as we need them
        * after freeing the link */
       link_options = l->link_options;
@@ -618,74 +735,280 @@ tsch_schedule_get_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t ti
   }
   return NULL;
 }
-/*---------------------------------------------------------------------------*///ksh.. 
-// atria time varying schedule
-#ifdef ALICE_TSCH_CALLBACK_SLOTFRAME_START
-void tsch_schedule_alice_data_Sf_reschedule(struct asn_t *asn){
-  
-  int flag=0;//ksh..
-  if(!tsch_is_locked()) {
-    struct tsch_slotframe *sf = list_head(slotframe_list);
-    while(sf != NULL) {
-      if(sf->handle== ALICE_UNICAST_SF_ID ){
-         uint16_t timeslot = ASN_MOD(*asn, sf->size);
-         struct tsch_link *l = list_head(sf->links_list);
-         while(l != NULL) {        
-           if(l->timeslot > timeslot){ // Check if any link exists after this timeslot in the current unicast slotframe
-                  flag=1; //In the current unicast slotframe schedule, the current timeslot is not a last one.
-           }
-           l = list_item_next(l);
-         }// while end .. link
-
-         if(flag==0){//It means that the current timeslot is the last timeslot scheduled on the current unicast slotframe. update ASFN and reschedule the slotframe.
-            uint16_t mod=ASN_MOD(*asn, sf->size);
-            struct asn_t newasn;
-            ASN_COPY(newasn, *asn);
-            ASN_DEC(newasn, mod);
-            uint16_t currSFID = ASN_DEVISION(newasn, sf->size);
-
-            uint16_t limitSFID = (uint16_t)(65535/(uint16_t)sf->size.val); //65535= 4Byte max value
-            if(currSFID==limitSFID){
-               ALICE_TSCH_CALLBACK_SLOTFRAME_START(0, (uint16_t)sf->size.val);
-            }else{
-               ALICE_TSCH_CALLBACK_SLOTFRAME_START(currSFID+1, (uint16_t)sf->size.val);
-            }
-         }
-         break;
-      }//end if (slotframe->handle == ALICE_UNICAST_SF_ID) (alice unicast slotframe)
-      sf = list_item_next(sf);
-    }//ksh.. while end .. sf
+/*---------------------------------------------------------------------------*/
+/* Stable merge sort of a segment of the link index by timeslot */
+static void
+link_index_sort(uint16_t start, uint16_t len)
+{
+  link_index_t *src = &link_index[start];
+  link_index_t *dst = &link_index_tmp[start];
+  link_index_t *tmp;
+  uint16_t width, lo, mid, hi, i, j, k;
+
+  for(width = 1; width < len; width *= 2) {
+    for(lo = 0; lo < len; lo += 2 * width) {
+      mid = MIN(lo + width, len);
+      hi = MIN(lo + 2 * width, len);
+      i = lo;
+      j = mid;
+      for(k = lo; k < hi; k++) {
+        if(i < mid && (j >= hi ||
+            ((struct tsch_link *)link_memb.mem + src[i])->timeslot
+            <= ((struct tsch_link *)link_memb.mem + src[j])->timeslot)) {
+          dst[k] = src[i++];
+        } else {
+          dst[k] = src[j++];
+        }
+      }
+    }
+    tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  if(src != &link_index[start]) {
+    memcpy(&link_index[start], src, len * sizeof(link_index_t));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+link_index_rebuild(void)
+{
+  struct tsch_slotframe *sf = list_head(slotframe_list);
+  uint16_t n = 0;
+
+  link_index_dirty = 0;
+  while(sf != NULL) {
+    struct tsch_link *l = list_head(sf->links_list);
+    sf->index_start = n;
+    while(l != NULL && n < TSCH_SCHEDULE_MAX_LINKS) {
+      link_index[n++] = l - (struct tsch_link *)link_memb.mem;
+      l = list_item_next(l);
+    }
+    sf->index_len = n - sf->index_start;
+    link_index_sort(sf->index_start, sf->index_len);
+    sf = list_item_next(sf);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Writes the segment of a slotframe whose links were rewritten in place from
+ * order, the list positions of its links by timeslot, or checks it is still
+ * sorted if order is NULL. No sort: linear in the links. Returns 0 if order
+ * does not match the links, the segment is then to be rebuilt */
+static int
+link_index_splice(const struct tsch_slotframe *sf, const uint16_t *order, uint16_t num)
+{
+  link_index_t *by_pos = &link_index_tmp[sf->index_start];
+  struct tsch_link *l, *prev = NULL;
+  uint16_t i, n = 0;
+
+  if(order != NULL) {
+    if(num != sf->index_len) {
+      return 0;
+    }
+    for(l = list_head(sf->links_list); l != NULL; l = list_item_next(l)) {
+      if(n == num) {
+        return 0;
+      }
+      by_pos[n++] = l - (struct tsch_link *)link_memb.mem;
+    }
+    if(n != num) {
+      return 0;
+    }
+  }
+  for(i = 0; i < sf->index_len; i++) {
+    if(order != NULL) {
+      if(order[i] >= num) {
+        return 0;
+      }
+      link_index[sf->index_start + i] = by_pos[order[i]];
+    }
+    l = INDEX_LINK(sf->index_start + i);
+    /* Sorted, and in list order within a timeslot: also rules out duplicates */
+    if(prev != NULL && (l->timeslot < prev->timeslot
+       || (l->timeslot == prev->timeslot && order != NULL && order[i] < order[i - 1]))) {
+      return 0;
+    }
+    prev = l;
   }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Position of the first link of a slotframe with a timeslot after the given one */
+static uint16_t
+link_index_upper_bound(const struct tsch_slotframe *sf, uint16_t timeslot)
+{
+  uint16_t lo = sf->index_start;
+  uint16_t hi = sf->index_start + sf->index_len;
+
+  while(lo < hi) {
+    uint16_t mid = lo + (hi - lo) / 2;
+    if(INDEX_LINK(mid)->timeslot > timeslot) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+/*---------------------------------------------------------------------------*/
+/* ASFN of the occurrence of a slotframe starting at a given ASN. Wraps at
+ * 65535/size, so that ASFN-based hashes stay within 16 bits */
+static uint16_t
+slotframe_asfn(const struct tsch_slotframe *sf, const struct asn_t *start)
+{
+  uint16_t limit = 65535 / sf->size.val;
+  return (uint16_t)((start->ls4b / sf->size.val) % (limit + 1));
 }
+/*---------------------------------------------------------------------------*/
+static void
+slotframe_start(struct tsch_slotframe *sf, const struct asn_t *start)
+{
+#if TSCH_SLOT_TIMING
+  rtimer_clock_t phase_start;
+#endif
+  TSCH_SLOT_TIMING_START(phase_start);
+  ASN_COPY(sf->start_asn, *start);
+  sf->start_announced = 1;
+#if TSCH_SCHEDULE_LOOKAHEAD
+  schedule_generation++;
 #endif
+  sf->start_callback(slotframe_asfn(sf, start), sf->size.val);
+  if(link_index_dirty) {
+    link_index_rebuild();
+  }
+  TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_RESCHEDULE, phase_start);
+}
 /*---------------------------------------------------------------------------*/
-/* Returns the next active link after a given ASN, and a backup link (for the same ASN, with Rx flag) */
-struct tsch_link *
-tsch_schedule_get_next_active_link(struct asn_t *asn, uint16_t *time_offset,
-    struct tsch_link **backup_link)
+/* Announces the next occurrence of a slotframe once no link of the current
+ * one is left, or the current occurrence if it was entered unannounced.
+ * Links beyond the slotframe size never occur and are not waited for.
+ * Returns 1 if the links are set up for the next occurrence, and -1 if
+ * an announcement is due but may_start is 0. */
+static int
+slotframe_start_check(struct tsch_slotframe *sf, const struct asn_t *asn, uint16_t timeslot, int may_start)
+{
+  struct asn_t start;
+  uint16_t i;
+
+  ASN_COPY(start, *asn);
+  ASN_DEC(start, timeslot);
+  if(!sf->start_announced || (int32_t)ASN_DIFF(start, sf->start_asn) > 0) {
+    if(!may_start) {
+      return -1;
+    }
+    slotframe_start(sf, &start);
+  }
+  if(!ASN_EQUAL(start, sf->start_asn)) {
+    return 1;
+  }
+
+  i = link_index_upper_bound(sf, timeslot);
+  if(i < sf->index_start + sf->index_len && INDEX_LINK(i)->timeslot < sf->size.val) {
+    return 0;
+  }
+  if(!may_start) {
+    return -1;
+  }
+  ASN_INC(start, sf->size.val);
+  slotframe_start(sf, &start);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_schedule_set_start_callback(struct tsch_slotframe *slotframe, tsch_schedule_start_callback_t callback)
+{
+  if(slotframe != NULL && tsch_get_lock()) {
+    slotframe->start_callback = callback;
+    slotframe->start_announced = 0;
+#if TSCH_SCHEDULE_LOOKAHEAD
+    schedule_generation++;
+#endif
+    tsch_release_lock();
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+alice_tsch_schedule_get_current_asfn(struct tsch_slotframe *slotframe)
+{
+  struct asn_t start;
+
+  if(slotframe == NULL) {
+    return 0;
+  }
+  ASN_COPY(start, current_asn);
+  ASN_DEC(start, ASN_MOD(current_asn, slotframe->size));
+  return slotframe_asfn(slotframe, &start);
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_schedule_links_updated(struct tsch_slotframe *slotframe)
+{
+  if(!link_index_dirty) {
+    link_index_rewritten = slotframe;
+  } else if(link_index_rewritten != slotframe) {
+    link_index_rewritten = NULL;
+  }
+  link_index_dirty = 1;
+#if TSCH_SCHEDULE_LOOKAHEAD
+  schedule_generation++;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_schedule_links_sorted(struct tsch_slotframe *slotframe, const uint16_t *order, uint16_t num)
+{
+  tsch_schedule_links_updated(slotframe);
+  if(slotframe != NULL && link_index_rewritten == slotframe
+     && link_index_splice(slotframe, order, num)) {
+    link_index_dirty = 0;
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* The search of tsch_schedule_get_next_active_link(). With may_start 0, the
+ * schedule is left as is: returns 0 if a slotframe start is due first */
+static int
+next_active_link(const struct asn_t *asn, uint16_t *time_offset,
+    struct tsch_link **link, struct tsch_link **backup_link, int may_start)
 {
-	//printf("GNE\n");
   uint16_t time_to_curr_best = 0;
   struct tsch_link *curr_best = NULL;
   struct tsch_link *curr_backup = NULL; /* Keep a back link in case the current link
   turns out useless when the time comes. For instance, for a Tx-only link, if there is
   no outgoing packet in queue. In that case, run the backup link instead. The backup link
   must have Rx flag set. */
-  if(!tsch_is_locked()) {
-	
-#ifdef ALICE_TSCH_CALLBACK_SLOTFRAME_START
-    tsch_schedule_alice_data_Sf_reschedule(asn); //atria time varying scheduling
-#endif
-
-    struct tsch_slotframe *sf = list_head(slotframe_list);
-    /* For each slotframe, look for the earliest occurring link */
-    while(sf != NULL) {
-      /* Get timeslot from ASN, given the slotframe length */
-      uint16_t timeslot = ASN_MOD(*asn, sf->size);
-      struct tsch_link *l = list_head(sf->links_list);
-      while(l != NULL) {
+  struct tsch_slotframe *sf = list_head(slotframe_list);
+  /* For each slotframe, look for the earliest occurring link */
+  while(sf != NULL) {
+    /* Get timeslot from ASN, given the slotframe length */
+    uint16_t timeslot = ASN_MOD(*asn, sf->size);
+    /* Are the links set up for the next occurrence already? */
+    int next_occurrence = sf->start_callback != NULL
+                          ? slotframe_start_check(sf, asn, timeslot, may_start) : 0;
+    if(next_occurrence < 0) {
+      return 0;
+    }
+    uint16_t end = sf->index_start + sf->index_len;
+    /* The earliest links are either the first ones after the current timeslot,
+     * or the first ones of the slotframe, in its next occurrence */
+    uint16_t i = next_occurrence ? end : link_index_upper_bound(sf, timeslot);
+    if(sf->index_len > 0) {
+      uint16_t first = sf->index_start;
+      if(i == end || (uint16_t)(sf->size.val + INDEX_LINK(first)->timeslot - timeslot)
+                     < (uint16_t)(INDEX_LINK(i)->timeslot - timeslot)) {
+        i = first;
+      }
+    }
+    if(i < end) {
+      uint16_t group_timeslot = INDEX_LINK(i)->timeslot;
+      /* Links sharing the earliest timeslot, in list order */
+      for(; i < end && INDEX_LINK(i)->timeslot == group_timeslot; i++) {
+        struct tsch_link *l = INDEX_LINK(i);
         uint16_t time_to_timeslot =
-          l->timeslot > timeslot ?
+          l->timeslot > timeslot && !next_occurrence ?
           l->timeslot - timeslot :
           sf->size.val + l->timeslot - timeslot; 
 
@@ -726,22 +1049,117 @@ tsch_schedule_get_next_active_link(struct asn_t *asn, uint16_t *time_offset,
             curr_best = new_best;
           }
         }
-
-        l = list_item_next(l);
-      }// while end .. link
-      sf = list_item_next(sf);
-    }// while end .. sf
-    if(time_offset != NULL) {
-      *time_offset = time_to_curr_best;
+      }// for end .. link
     }
+    sf = list_item_next(sf);
+  }// while end .. sf
+  if(time_offset != NULL) {
+    *time_offset = time_to_curr_best;
   }
   if(backup_link != NULL) {
     *backup_link = curr_backup;
   }
+  *link = curr_best;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the next active link after a given ASN, and a backup link (for the same ASN, with Rx flag) */
+struct tsch_link *
+tsch_schedule_get_next_active_link(struct asn_t *asn, uint16_t *time_offset,
+    struct tsch_link **backup_link)
+{
+  struct tsch_link *link = NULL;
+  if(!tsch_is_locked()) {
+    if(link_index_dirty) {
+      link_index_rebuild();
+    }
+    next_active_link(asn, time_offset, &link, backup_link, 1);
+  } else if(backup_link != NULL) {
+    *backup_link = NULL;
+  }
+  return link;
+}
+/*---------------------------------------------------------------------------*/
+#if TSCH_SCHEDULE_LOOKAHEAD
+/* Searches the next active links ahead, until the window is full or a
+ * slotframe start is due: the slot operation announces it as it gets there */
+static void
+lookahead_fill(void)
+{
+  /* Search start of the next entry */
+  static struct asn_t next_asn;
+  static uint16_t fill_generation;
+  struct lookahead_entry *e;
+  uint16_t generation;
+  int16_t put_index;
+
+  if(tsch_is_locked() || link_index_dirty) {
+    return;
+  }
+  generation = schedule_generation;
+  if(ringbufindex_elements(&lookahead_ringbuf) == 0 || generation != fill_generation) {
+    /* Start over from the slot to come */
+    ASN_COPY(next_asn, current_asn);
+    fill_generation = generation;
+  }
+  while((put_index = ringbufindex_peek_put(&lookahead_ringbuf)) != -1) {
+    e = &lookahead_array[put_index];
+    ASN_COPY(e->asn, next_asn);
+    e->link = NULL;
+    if(!next_active_link(&e->asn, &e->time_offset, &e->link, &e->backup_link, 0)
+       || e->link == NULL
+       /* The slot operation changed the schedule meanwhile */
+       || schedule_generation != generation) {
+      break;
+    }
+    e->generation = generation;
+    ringbufindex_put(&lookahead_ringbuf);
+    ASN_INC(next_asn, e->time_offset);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tsch_schedule_lookahead_process, ev, data)
+{
+  PROCESS_BEGIN();
 
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    lookahead_fill();
+  }
 
-
-  return curr_best;
+  PROCESS_END();
+}
+#endif /* TSCH_SCHEDULE_LOOKAHEAD */
+/*---------------------------------------------------------------------------*/
+struct tsch_link *
+tsch_schedule_get_next_active_link_lookahead(struct asn_t *asn, uint16_t *time_offset,
+    struct tsch_link **backup_link)
+{
+#if TSCH_SCHEDULE_LOOKAHEAD
+  struct lookahead_entry *e;
+  int16_t get_index;
+
+  process_poll(&tsch_schedule_lookahead_process);
+  /* Skip the entries that no longer hold. While the schedule is locked,
+   * their links may be freed or half rewritten: leave them alone */
+  while(!tsch_is_locked()
+        && (get_index = ringbufindex_peek_get(&lookahead_ringbuf)) != -1) {
+    e = &lookahead_array[get_index];
+    if(e->generation == schedule_generation && ASN_EQUAL(e->asn, *asn)) {
+      struct tsch_link *link = e->link;
+      if(time_offset != NULL) {
+        *time_offset = e->time_offset;
+      }
+      if(backup_link != NULL) {
+        *backup_link = e->backup_link;
+      }
+      ringbufindex_get(&lookahead_ringbuf);
+      return link;
+    }
+    ringbufindex_get(&lookahead_ringbuf);
+  }
+#endif /* TSCH_SCHEDULE_LOOKAHEAD */
+  return tsch_schedule_get_next_active_link(asn, time_offset, backup_link);
 }
 /*---------------------------------------------------------------------------*/
 /* Module initialization, call only once at startup. Returns 1 is success, 0 if failure. */
@@ -752,6 +1170,10 @@ tsch_schedule_init(void)
     memb_init(&link_memb);
     memb_init(&slotframe_memb);
     list_init(slotframe_list);
+#if TSCH_SCHEDULE_LOOKAHEAD
+    ringbufindex_init(&lookahead_ringbuf, TSCH_SCHEDULE_LOOKAHEAD);
+    process_start(&tsch_schedule_lookahead_process, NULL);
+#endif
     tsch_release_lock();
     return 1;
   } else {
@@ -779,6 +1201,46 @@ tsch_schedule_create_minimal(void)
       0, 0);
 }
 /*---------------------------------------------------------------------------*/
+#if TSCH_SCHEDULE_WITH_CELL_STATS
+/* The statistics of the position of a link, NULL if it is not counted */
+struct tsch_cell_stats *
+tsch_schedule_cell_stats(const struct tsch_link *l)
+{
+  uint16_t position = l->timeslot / TSCH_SCHEDULE_CELL_STATS_GROUP;
+
+  if(l->slotframe_handle != TSCH_SCHEDULE_CELL_STATS_SF
+     || position >= TSCH_SCHEDULE_CELL_STATS_POSITIONS) {
+    return NULL;
+  }
+  return &cell_stats[l->direction == 2 ? TSCH_CELL_STATS_UP : TSCH_CELL_STATS_DOWN][position];
+}
+/*---------------------------------------------------------------------------*/
+/* Prints the statistics of the positions with any outcome, one line each */
+void
+tsch_schedule_print_cell_stats(void)
+{
+  struct tsch_cell_stats *s;
+  uint16_t d, p;
+
+  /* Direction (0 up, 1 down) and position: then the counters */
+  for(d = 0; d < TSCH_CELL_STATS_NUM_DIRS; d++) {
+    for(p = 0; p < TSCH_SCHEDULE_CELL_STATS_POSITIONS; p++) {
+      s = &cell_stats[d][p];
+      if(s->tx != 0 || s->rx_idle != 0 || s->rx_seen != 0) {
+        printf("cell %u %u: %u %u %u %u %u %u %u\n", d, p,
+               s->tx, s->tx_ok, s->tx_noack, s->tx_collision, s->rx_idle, s->rx_seen, s->rx_ok);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_schedule_reset_cell_stats(void)
+{
+  memset(cell_stats, 0, sizeof(cell_stats));
+}
+#endif /* TSCH_SCHEDULE_WITH_CELL_STATS */
+/*---------------------------------------------------------------------------*/
 /* Prints out the current schedule (all slotframes and links) */
 void
 tsch_schedule_print(void)
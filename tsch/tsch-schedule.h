@@ -72,6 +72,43 @@
 #define TSCH_SCHEDULE_MAX_LINKS 32
 #endif
 
+/* Number of upcoming active links computed ahead by a process, for the slot
+ * operation to take in O(1) instead of searching the schedule at the end of
+ * each slot. Power of two. 0: search at the end of each slot, as stock TSCH */
+#ifdef TSCH_SCHEDULE_CONF_LOOKAHEAD
+#define TSCH_SCHEDULE_LOOKAHEAD TSCH_SCHEDULE_CONF_LOOKAHEAD
+#else
+#define TSCH_SCHEDULE_LOOKAHEAD 0
+#endif
+
+/* Count the Tx and Rx outcomes of the cells of one slotframe by position,
+ * see tsch_schedule_cell_stats() */
+#ifdef TSCH_SCHEDULE_CONF_WITH_CELL_STATS
+#define TSCH_SCHEDULE_WITH_CELL_STATS TSCH_SCHEDULE_CONF_WITH_CELL_STATS
+#else
+#define TSCH_SCHEDULE_WITH_CELL_STATS 0
+#endif
+
+/* The slotframe counted */
+#ifdef TSCH_SCHEDULE_CONF_CELL_STATS_SF
+#define TSCH_SCHEDULE_CELL_STATS_SF TSCH_SCHEDULE_CONF_CELL_STATS_SF
+#else
+#define TSCH_SCHEDULE_CELL_STATS_SF 0
+#endif
+
+/* Timeslots per position, and positions counted from timeslot 0 on */
+#ifdef TSCH_SCHEDULE_CONF_CELL_STATS_GROUP
+#define TSCH_SCHEDULE_CELL_STATS_GROUP TSCH_SCHEDULE_CONF_CELL_STATS_GROUP
+#else
+#define TSCH_SCHEDULE_CELL_STATS_GROUP 1
+#endif
+
+#ifdef TSCH_SCHEDULE_CONF_CELL_STATS_POSITIONS
+#define TSCH_SCHEDULE_CELL_STATS_POSITIONS TSCH_SCHEDULE_CONF_CELL_STATS_POSITIONS
+#else
+#define TSCH_SCHEDULE_CELL_STATS_POSITIONS 64
+#endif
+
 /********** Constants *********/
 
 /* Link options */
@@ -118,6 +155,26 @@ struct tsch_link {
   void *data;
 };
 
+/* Called once per slotframe occurrence, before its links are looked up,
+ * with its absolute slotframe number (ASFN) and size */
+typedef void (* tsch_schedule_start_callback_t)(uint16_t asfn, uint16_t size);
+
+/* Outcomes of the cells at one position of the slotframe, over all ASFNs
+ * and whatever the links placed there, by direction of the link */
+#define TSCH_CELL_STATS_UP       0 /* Links with direction 2, to the parent */
+#define TSCH_CELL_STATS_DOWN     1 /* Other links: children, padding */
+#define TSCH_CELL_STATS_NUM_DIRS 2
+
+struct tsch_cell_stats {
+  uint16_t tx;           /* Tx attempts */
+  uint16_t tx_ok;        /* Acked, or sent if broadcast */
+  uint16_t tx_noack;
+  uint16_t tx_collision; /* Channel busy */
+  uint16_t rx_idle;      /* Nothing on air */
+  uint16_t rx_seen;      /* Something on air */
+  uint16_t rx_ok;        /* Of which a valid frame for us */
+};
+
 struct tsch_slotframe {
   /* Slotframes are stored as a list: "next" must be the first field */
   struct tsch_slotframe *next;
@@ -128,6 +185,14 @@ struct tsch_slotframe {
   struct asn_divisor_t size;
   /* List of links belonging to this slotframe */
   LIST_STRUCT(links_list);
+  /* This slotframe's links in the timeslot-sorted link index */
+  uint16_t index_start;
+  uint16_t index_len;
+  /* Start hook, NULL if none */
+  tsch_schedule_start_callback_t start_callback;
+  /* First ASN of the occurrence last announced to start_callback */
+  struct asn_t start_asn;
+  uint8_t start_announced;
 };
 
 /********** Functions *********/
@@ -143,6 +208,14 @@ int tsch_schedule_init(void);
 void tsch_schedule_create_minimal(void);
 /* Prints out the current schedule (all slotframes and links) */
 void tsch_schedule_print(void);
+#if TSCH_SCHEDULE_WITH_CELL_STATS
+/* The statistics of the position of a link, NULL if it is not counted */
+struct tsch_cell_stats *tsch_schedule_cell_stats(const struct tsch_link *l);
+/* Prints the statistics of the positions with any outcome, one line each */
+void tsch_schedule_print_cell_stats(void);
+/* Clear the statistics */
+void tsch_schedule_reset_cell_stats(void);
+#endif
 
 /* Adds and returns a slotframe (NULL if failure) */
 struct tsch_slotframe *tsch_schedule_add_slotframe(uint16_t handle, uint16_t size);
@@ -180,8 +253,31 @@ int tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link
 /* Removes a link from slotframe and timeslot. Return a 1 if success, 0 if failure */
 int tsch_schedule_remove_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t timeslot);
 
+/* Registers the start hook of a slotframe. It is called as soon as no link of
+ * the current occurrence is left, for the next occurrence, and the links are
+ * then looked up in that occurrence. Returns 1 if success, 0 if failure */
+int tsch_schedule_set_start_callback(struct tsch_slotframe *slotframe, tsch_schedule_start_callback_t callback);
+/* Returns the ASFN of the current occurrence of a slotframe */
+uint16_t alice_tsch_schedule_get_current_asfn(struct tsch_slotframe *slotframe);
+
+/* To be called before and after changing the timeslot of links in place */
+void tsch_schedule_links_updated(struct tsch_slotframe *slotframe);
+/* To be called after changing links in place instead of the second
+ * tsch_schedule_links_updated(), with the new order of the links of the
+ * slotframe: order[k] is the position in links_list of the link with the
+ * k-th earliest timeslot, ties in list order, for all num links. NULL if no
+ * timeslot changed. The link index is then updated in linear time instead of
+ * sorted again on next use, as fits the slot operation. Returns 1 if so, 0 if
+ * order does not match the links and the index is left to be rebuilt */
+int tsch_schedule_links_sorted(struct tsch_slotframe *slotframe, const uint16_t *order, uint16_t num);
+
 /* Returns the next active link after a given ASN, and a backup link (for the same ASN, with Rx flag) */
 struct tsch_link * tsch_schedule_get_next_active_link(struct asn_t *asn, uint16_t *time_offset,
     struct tsch_link **backup_link);
+/* tsch_schedule_get_next_active_link() from the lookahead window when it is
+ * still valid for this ASN, searching the schedule otherwise. For the slot
+ * operation only */
+struct tsch_link *tsch_schedule_get_next_active_link_lookahead(struct asn_t *asn, uint16_t *time_offset,
+    struct tsch_link **backup_link);
 
 #endif /* __TSCH_SCHEDULE_H__ */
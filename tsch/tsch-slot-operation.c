@@ -54,6 +54,7 @@
 #include "net/mac/tsch/tsch-packet.h"
 #include "net/mac/tsch/tsch-security.h"
 #include "net/mac/tsch/tsch-adaptive-timesync.h"
+#include <string.h>
 
 #include "net/rpl/rpl.h"//ksh
 #include "net/rpl/rpl-private.h" //ksh
@@ -183,6 +184,47 @@ static struct tsch_link *backup_link = NULL;
 static struct tsch_packet *current_packet = NULL;
 static struct tsch_neighbor *current_neighbor = NULL;
 
+#if TSCH_SLOT_TIMING
+struct tsch_slot_timing tsch_slot_timing;
+/* Start of the slot phase in progress */
+static rtimer_clock_t slot_phase_start;
+#endif
+struct tsch_slot_misses tsch_slot_misses;
+volatile uint8_t tsch_slot_overloaded = 0;
+#if TSCH_OVERLOAD_THRESHOLD
+/* Slots and misses of the overload window in progress */
+static uint16_t window_slots;
+static uint16_t window_misses;
+#endif
+
+#if TSCH_WITH_MAC_STATS
+/* MAC statistics by neighbor index. An entry holds the address it counts
+ * for, and is folded into past_mac_stats once the index is reused */
+struct mac_stats_entry {
+  linkaddr_t addr;
+  struct tsch_mac_stats stats;
+};
+static struct mac_stats_entry mac_stats[TSCH_QUEUE_MAX_NEIGHBOR_QUEUES];
+static struct tsch_mac_stats past_mac_stats;
+#endif
+
+#if TSCH_SCHEDULE_WITH_CELL_STATS
+#define CELL_STATS_INC(field) do { \
+    struct tsch_cell_stats *cs = tsch_schedule_cell_stats(current_link); \
+    if(cs != NULL) { \
+      cs->field++; \
+    } \
+  } while(0)
+#else
+#define CELL_STATS_INC(field)
+#endif
+
+/* End the slot phase in progress, the next one starts */
+#define SLOT_PHASE_END(phase) do { \
+    TSCH_SLOT_TIMING_END(phase, slot_phase_start); \
+    TSCH_SLOT_TIMING_START(slot_phase_start); \
+  } while(0)
+
 /* Protothread for association */
 PT_THREAD(tsch_scan(struct pt *pt));
 /* Protothread for slot operation, called from rtimer interrupt
@@ -193,6 +235,147 @@ static struct pt slot_operation_pt;
 static PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t));
 static PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t));
 
+#if TSCH_SLOT_TIMING
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_add(enum tsch_slot_phase phase, rtimer_clock_t duration)
+{
+  uint8_t b = 0;
+  /* Bucket: bit length of the duration */
+  while(b < TSCH_SLOT_TIMING_BUCKETS - 1 && (duration >> b) != 0) {
+    b++;
+  }
+  if(tsch_slot_timing.count[phase][b] != 0xffff) {
+    tsch_slot_timing.count[phase][b]++;
+  }
+  if(duration > tsch_slot_timing.max[phase]) {
+    tsch_slot_timing.max[phase] = duration;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_reset(void)
+{
+  memset(&tsch_slot_timing, 0, sizeof(tsch_slot_timing));
+}
+#endif /* TSCH_SLOT_TIMING */
+/*---------------------------------------------------------------------------*/
+/* Accounts the end of a slot, which skipped over the given number of active
+ * slots for missed deadlines, and updates tsch_slot_overloaded */
+static void
+tsch_slot_misses_update(uint16_t skipped)
+{
+  if(skipped > 0) {
+    tsch_slot_misses.missed++;
+    tsch_slot_misses.skipped_slots += skipped;
+    if(skipped > tsch_slot_misses.max_skipped) {
+      tsch_slot_misses.max_skipped = skipped;
+    }
+  }
+#if TSCH_OVERLOAD_THRESHOLD
+  window_misses += skipped > 0;
+  if(++window_slots >= TSCH_OVERLOAD_WINDOW) {
+    if(window_misses >= TSCH_OVERLOAD_THRESHOLD) {
+      tsch_slot_misses.overloaded++;
+      tsch_slot_overloaded = 1;
+    } else if(window_misses == 0) {
+      tsch_slot_overloaded = 0;
+    }
+    window_slots = 0;
+    window_misses = 0;
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if TSCH_WITH_MAC_STATS
+static void
+mac_stats_add(struct tsch_mac_stats *to, const struct tsch_mac_stats *from)
+{
+  int d, s;
+  for(d = 0; d < TSCH_MAC_STATS_NUM_DIRS; d++) {
+    for(s = 0; s < TSCH_MAC_STATS_NUM_STATUS; s++) {
+      to->tx[d][s] += from->tx[d][s];
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The MAC statistics of a neighbor, called from the slot operation */
+static struct tsch_mac_stats *
+mac_stats_for_nbr(const struct tsch_neighbor *n)
+{
+  struct mac_stats_entry *e = &mac_stats[tsch_queue_nbr_index(n)];
+  if(!linkaddr_cmp(&e->addr, &n->addr)) {
+    /* A new neighbor in this entry */
+    mac_stats_add(&past_mac_stats, &e->stats);
+    memset(&e->stats, 0, sizeof(e->stats));
+    linkaddr_copy(&e->addr, &n->addr);
+  }
+  return &e->stats;
+}
+#endif /* TSCH_WITH_MAC_STATS */
+/*---------------------------------------------------------------------------*/
+int
+tsch_mac_stats_snapshot(struct tsch_mac_stats *total)
+{
+#if TSCH_WITH_MAC_STATS
+  int i;
+  if(tsch_get_lock()) {
+    memcpy(total, &past_mac_stats, sizeof(*total));
+    for(i = 0; i < TSCH_QUEUE_MAX_NEIGHBOR_QUEUES; i++) {
+      mac_stats_add(total, &mac_stats[i].stats);
+    }
+    tsch_release_lock();
+    return 1;
+  }
+  return 0;
+#else
+  memset(total, 0, sizeof(*total));
+  return 1;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+const struct tsch_mac_stats *
+tsch_mac_stats_get(const linkaddr_t *addr)
+{
+#if TSCH_WITH_MAC_STATS
+  int i;
+  for(i = 0; i < TSCH_QUEUE_MAX_NEIGHBOR_QUEUES; i++) {
+    if(linkaddr_cmp(&mac_stats[i].addr, addr)) {
+      return &mac_stats[i].stats;
+    }
+  }
+#endif
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+tsch_mac_stats_errors(const struct tsch_mac_stats *stats, int dir)
+{
+  uint16_t errors = 0;
+  int s;
+  for(s = 0; s < TSCH_MAC_STATS_NUM_STATUS; s++) {
+    if(s != MAC_TX_OK) {
+      errors += stats->tx[dir][s];
+    }
+  }
+  return errors;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_mac_stats_reset(void)
+{
+#if TSCH_WITH_MAC_STATS
+  if(tsch_get_lock()) {
+    memset(mac_stats, 0, sizeof(mac_stats));
+    memset(&past_mac_stats, 0, sizeof(past_mac_stats));
+    tsch_release_lock();
+    return 1;
+  }
+  return 0;
+#else
+  return 1;
+#endif
+}
 /*---------------------------------------------------------------------------*/
 /* TSCH locking system. TSCH is locked during slot operations */
 
@@ -553,7 +736,9 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
 #endif /* LLSEC802154_ENABLED */
 
       /* prepare packet to send: copy to radio buffer */
-      if(packet_ready && NETSTACK_RADIO.prepare(packet, packet_len) == 0) { /* 0 means success */
+      packet_ready = packet_ready && NETSTACK_RADIO.prepare(packet, packet_len) == 0; /* 0 means success */
+      SLOT_PHASE_END(TSCH_SLOT_PHASE_PREPARE);
+      if(packet_ready) {
         static rtimer_clock_t tx_duration;
 
 #if CCA_ENABLED
@@ -695,61 +880,34 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
     }
 
     tsch_radio_off(TSCH_RADIO_CMD_OFF_END_OF_TIMESLOT);
+    SLOT_PHASE_END(TSCH_SLOT_PHASE_TX);
 
     current_packet->transmissions++;
 
-//----------------------------
-   if(current_link->slotframe_handle == ALICE_UNICAST_SF_ID) {
-     
-      int up1_down2=2; //default is downstream
-      rpl_instance_t *instance =rpl_get_default_instance();
-      if(instance==NULL || instance->current_dag==NULL || instance->current_dag->preferred_parent==NULL){
-         //do nothing
-      }else{
-	if(linkaddr_cmp(queuebuf_addr(current_packet->qb, PACKETBUF_ADDR_RECEIVER),rpl_get_parent_lladdr(instance->current_dag->preferred_parent))){
-            up1_down2=1;
-         }else{
-            up1_down2=2;   
-         }
-      }
-
-      if(up1_down2==1){ //upstream
-         if(mac_tx_status==MAC_TX_OK){
-            mac_tx_up_ok_counter++;
-         }else{
-            mac_tx_up_error_counter++;
-            if(mac_tx_status==MAC_TX_COLLISION){
-                mac_tx_up_collision_counter++;
-            }else if(mac_tx_status==MAC_TX_NOACK){
-                mac_tx_up_noack_counter++;
-            }else if(mac_tx_status==MAC_TX_DEFERRED){
-                mac_tx_up_deferred_counter++;
-            }else if(mac_tx_status==MAC_TX_ERR){
-                mac_tx_up_err_counter++;
-            }else if(mac_tx_status==MAC_TX_ERR_FATAL){
-                mac_tx_up_err_fatal_counter++;
-            }
-         }
-      }else{ //downstream
-         if(mac_tx_status==MAC_TX_OK){
-            mac_tx_down_ok_counter++;
-         }else{
-            mac_tx_down_error_counter++;
-            if(mac_tx_status==MAC_TX_COLLISION){
-                mac_tx_down_collision_counter++;
-            }else if(mac_tx_status==MAC_TX_NOACK){
-                mac_tx_down_noack_counter++;
-            }else if(mac_tx_status==MAC_TX_DEFERRED){
-                mac_tx_down_deferred_counter++;
-            }else if(mac_tx_status==MAC_TX_ERR){
-                mac_tx_down_err_counter++;
-            }else if(mac_tx_status==MAC_TX_ERR_FATAL){
-                mac_tx_down_err_fatal_counter++;
-            }
-         }
+#if TSCH_SCHEDULE_WITH_CELL_STATS
+    {
+      struct tsch_cell_stats *cs = tsch_schedule_cell_stats(current_link);
+      if(cs != NULL) {
+        cs->tx++;
+        if(mac_tx_status == MAC_TX_OK) {
+          cs->tx_ok++;
+        } else if(mac_tx_status == MAC_TX_NOACK) {
+          cs->tx_noack++;
+        } else if(mac_tx_status == MAC_TX_COLLISION) {
+          cs->tx_collision++;
+        }
       }
-   }
-//--------------------------------------------------------
+    }
+#endif
+#if TSCH_WITH_MAC_STATS
+    /* MAC statistics, up if the frame went to the parent. Not by the link:
+     * a Tx|Rx cell may be shared by the parent and a child link, and the
+     * padding links have no direction */
+    if(current_link->slotframe_handle == ALICE_UNICAST_SF_ID && mac_tx_status < TSCH_MAC_STATS_NUM_STATUS) {
+      mac_stats_for_nbr(current_neighbor)->tx[current_neighbor->is_time_source ? TSCH_MAC_STATS_UP
+                                              : TSCH_MAC_STATS_DOWN][mac_tx_status]++;
+    }
+#endif
 
 
     current_packet->ret = mac_tx_status;
@@ -782,6 +940,7 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
 
     /* Poll process for later processing of packet sent events and logs */
     process_poll(&tsch_pending_events_process);
+    TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_POST, slot_phase_start);
   }
 
   TSCH_DEBUG_TX_EVENT();
@@ -845,8 +1004,10 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
     if(!packet_seen) {
       /* no packets on air */
       tsch_radio_off(TSCH_RADIO_CMD_OFF_FORCE);
+      CELL_STATS_INC(rx_idle);
     } else {
       TSCH_DEBUG_RX_EVENT();
+      CELL_STATS_INC(rx_seen);
       /* Save packet timestamp */
       rx_start_time = RTIMER_NOW() - RADIO_DELAY_BEFORE_DETECT;
 
@@ -966,6 +1127,7 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
 
             /* Add current input to ringbuf */
             ringbufindex_put(&input_ringbuf);
+            CELL_STATS_INC(rx_ok);
 
             /* Log every reception */
             TSCH_LOG_ADD(tsch_log_rx,
@@ -1021,7 +1183,9 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
                             tsch_lock_requested,
                             current_link == NULL);
       );
-    
+      if(tsch_lock_requested) {
+        tsch_slot_misses.lock_skipped++;
+      }
     } else {
       int is_active_slot;
       TSCH_DEBUG_SLOT_START();
@@ -1030,6 +1194,7 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
       drift_correction = 0;
       is_drift_correction_used = 0;
       /* Get a packet ready to be sent */
+      TSCH_SLOT_TIMING_START(slot_phase_start);
       current_packet = get_packet_and_neighbor_for_link(current_link, &current_neighbor);
       /* There is no packet to send, and this link does not have Rx flag. Instead of doing
        * nothing, switch to the backup link (has Rx flag) if any. */
@@ -1045,6 +1210,7 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
       
         }
       }
+      SLOT_PHASE_END(TSCH_SLOT_PHASE_SELECT);
       is_active_slot = current_packet != NULL || (current_link->link_options & LINK_OPTION_RX);
       if(is_active_slot) {
         /* Hop channel */
@@ -1065,7 +1231,9 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
         } else {
           /* Listen */
           static struct pt slot_rx_pt;
+          SLOT_PHASE_END(TSCH_SLOT_PHASE_PREPARE);
           PT_SPAWN(&slot_operation_pt, &slot_rx_pt, tsch_rx_slot(&slot_rx_pt, t));
+          TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_RX, slot_phase_start);
         }
       }
       TSCH_DEBUG_SLOT_END();
@@ -1092,6 +1260,9 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
       rtimer_clock_t prev_slot_start;
       /* Time to next wake up */
       rtimer_clock_t time_to_next_active_slot;
+      /* Active slots skipped for missed deadlines */
+      uint16_t skipped = 0;
+      int scheduled;
       /* Schedule next wakeup skipping slots if missed deadline */
       do {
         if(current_link != NULL
@@ -1103,7 +1274,9 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
         }
 	     
         /* Get next active link */
-        current_link = tsch_schedule_get_next_active_link(&current_asn, &timeslot_diff, &backup_link);
+        TSCH_SLOT_TIMING_START(slot_phase_start);
+        current_link = tsch_schedule_get_next_active_link_lookahead(&current_asn, &timeslot_diff, &backup_link);
+        TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_NEXT_LINK, slot_phase_start);
         if(current_link == NULL) {
           /* There is no next link. Fall back to default
            * behavior: wake up at the next slot. */
@@ -1124,7 +1297,10 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
         prev_slot_start = current_slot_start;
         current_slot_start += time_to_next_active_slot;
         current_slot_start += tsch_timesync_adaptive_compensate(time_to_next_active_slot);
-      } while(!tsch_schedule_slot_operation(t, prev_slot_start, time_to_next_active_slot, "main"));
+        scheduled = tsch_schedule_slot_operation(t, prev_slot_start, time_to_next_active_slot, "main");
+        skipped += !scheduled;
+      } while(!scheduled);
+      tsch_slot_misses_update(skipped);
     }
     tsch_in_slot_operation = 0;
 
@@ -145,6 +145,105 @@
 #define TSCH_AUTOSELECT_TIME_SOURCE 0
 #endif /* TSCH_CONF_EB_AUTOSELECT */
 
+/* Mix function of real_hash() */
+#define TSCH_CELL_HASH_WANG     0 /* Thomas Wang 32-bit integer mix, truncated */
+#define TSCH_CELL_HASH_MURMUR3  1 /* MurmurHash3 32-bit finalizer, folded to 16 bits */
+#define TSCH_CELL_HASH_XORSHIFT 2 /* 16-bit xorshift-multiply */
+
+#ifdef TSCH_CONF_CELL_HASH
+#define TSCH_CELL_HASH TSCH_CONF_CELL_HASH
+#else
+#define TSCH_CELL_HASH TSCH_CELL_HASH_WANG
+#endif
+
+/* Rehash values that would make real_hash_mod() favor the low residues */
+#ifdef TSCH_CONF_CELL_HASH_UNBIASED
+#define TSCH_CELL_HASH_UNBIASED TSCH_CONF_CELL_HASH_UNBIASED
+#else
+#define TSCH_CELL_HASH_UNBIASED 0
+#endif
+
+/* Time each phase of the slot operation with RTIMER_NOW() into log2
+ * histograms, tsch_slot_timing. Compiled out by default */
+#ifdef TSCH_CONF_SLOT_TIMING
+#define TSCH_SLOT_TIMING TSCH_CONF_SLOT_TIMING
+#else
+#define TSCH_SLOT_TIMING 0
+#endif
+
+/* Phases of the slot operation */
+enum tsch_slot_phase {
+  TSCH_SLOT_PHASE_SELECT,     /* get_packet_and_neighbor_for_link, backup link included */
+  TSCH_SLOT_PHASE_PREPARE,    /* Channel hop, radio on, and for Tx the frame to the radio */
+  TSCH_SLOT_PHASE_TX,         /* CCA, Tx and ACK */
+  TSCH_SLOT_PHASE_RX,         /* Rx slot, ACK included */
+  TSCH_SLOT_PHASE_POST,       /* Tx status: counters, neighbor state, log */
+  TSCH_SLOT_PHASE_NEXT_LINK,  /* tsch_schedule_get_next_active_link, RESCHEDULE included */
+  TSCH_SLOT_PHASE_RESCHEDULE, /* Slotframe start callbacks, i.e. the ATRIA reschedule */
+  TSCH_SLOT_PHASE_NUM
+};
+
+/* Bucket b counts the durations of bit length b: 0, 1, 2-3, 4-7 ... rtimer
+ * ticks; the last bucket everything longer */
+#define TSCH_SLOT_TIMING_BUCKETS 16
+
+struct tsch_slot_timing {
+  uint16_t count[TSCH_SLOT_PHASE_NUM][TSCH_SLOT_TIMING_BUCKETS]; /* Saturating */
+  rtimer_clock_t max[TSCH_SLOT_PHASE_NUM];
+};
+
+#if TSCH_SLOT_TIMING
+#define TSCH_SLOT_TIMING_START(start) ((start) = RTIMER_NOW())
+#define TSCH_SLOT_TIMING_END(phase, start) tsch_slot_timing_add((phase), RTIMER_NOW() - (start))
+#else
+#define TSCH_SLOT_TIMING_START(start)
+#define TSCH_SLOT_TIMING_END(phase, start)
+#endif
+
+/* Deadline misses of the slot operation, over a window of this many slots,
+ * beyond which the slot operation is flagged as overloaded and the slotframe
+ * start callbacks may defer their work, see tsch_slot_overloaded.
+ * The flag is cleared after a window without miss. 0: never overloaded */
+#ifdef TSCH_CONF_OVERLOAD_THRESHOLD
+#define TSCH_OVERLOAD_THRESHOLD TSCH_CONF_OVERLOAD_THRESHOLD
+#else
+#define TSCH_OVERLOAD_THRESHOLD 4
+#endif
+
+#ifdef TSCH_CONF_OVERLOAD_WINDOW
+#define TSCH_OVERLOAD_WINDOW TSCH_CONF_OVERLOAD_WINDOW
+#else
+#define TSCH_OVERLOAD_WINDOW 128
+#endif
+
+/* Slots the slot operation did not run */
+struct tsch_slot_misses {
+  uint32_t missed;        /* End of slot past the next wakeup deadline */
+  uint32_t skipped_slots; /* Active slots skipped over by these misses */
+  uint16_t max_skipped;   /* Most active slots skipped over by one miss */
+  uint32_t lock_skipped;  /* Slots skipped as the TSCH lock was requested */
+  uint32_t overloaded;    /* Windows over TSCH_OVERLOAD_THRESHOLD */
+};
+
+/* Unicast Tx over the ATRIA unicast slotframe are counted per neighbor, by
+ * direction and by MAC_TX_* status (OK, COLLISION, NOACK, DEFERRED, ERR,
+ * ERR_FATAL). Without TSCH_WITH_MAC_STATS nothing is counted and the
+ * statistics read as zero. */
+#ifdef TSCH_CONF_WITH_MAC_STATS
+#define TSCH_WITH_MAC_STATS TSCH_CONF_WITH_MAC_STATS
+#else
+#define TSCH_WITH_MAC_STATS 0
+#endif
+
+#define TSCH_MAC_STATS_UP         0 /* Tx to the time source, the RPL parent */
+#define TSCH_MAC_STATS_DOWN       1 /* Tx to any other neighbor, a child */
+#define TSCH_MAC_STATS_NUM_DIRS   2
+#define TSCH_MAC_STATS_NUM_STATUS 6
+
+struct tsch_mac_stats {
+  uint16_t tx[TSCH_MAC_STATS_NUM_DIRS][TSCH_MAC_STATS_NUM_STATUS];
+};
+
 /*********** Callbacks *********/
 
 /* Called by TSCH when joining a network */
@@ -156,40 +255,37 @@ void TSCH_CALLBACK_JOINING_NETWORK();
 #ifdef TSCH_CALLBACK_LEAVING_NETWORK
 void TSCH_CALLBACK_LEAVING_NETWORK();
 #endif
-/*** real hash, Thomas Wang, 32-bit integer mix function ***/
+/*** real hash, the cell hash of ALICE/ATRIA. All nodes must use the same one. ***/
 uint16_t real_hash(uint16_t value, uint16_t mod);
+/* The mix alone, for callers deriving several values from one hash */
+uint16_t real_hash_mix(uint16_t value);
+/* Reduces a mixed value to 0..mod-1 */
+uint16_t real_hash_mod(uint16_t hash, uint16_t mod);
+/*** ATRIA packet selection is memoized by the queue until the next ASFN or routing change ***/
+void tsch_queue_invalidate_packet_selection(void);
 
 
 /***** External Variables *****/
 
 
-extern int mac_tx_up_ok_counter;
-extern int mac_tx_up_error_counter;
-
-extern int mac_tx_up_collision_counter;
-extern int mac_tx_up_noack_counter;
-extern int mac_tx_up_deferred_counter;
-extern int mac_tx_up_err_counter;
-extern int mac_tx_up_err_fatal_counter;
-
 extern int tsch_queue_overflow;
 
-extern int mac_tx_down_ok_counter;
-extern int mac_tx_down_error_counter;
-
-extern int mac_tx_down_collision_counter;
-extern int mac_tx_down_noack_counter;
-extern int mac_tx_down_deferred_counter;
-extern int mac_tx_down_err_counter;
-extern int mac_tx_down_err_fatal_counter;
-
 
 extern uint16_t num_pktdrop_queue;
 extern uint16_t num_pktdrop_mac;
 
+extern struct tsch_slot_misses tsch_slot_misses;
+/* Set by the slot operation while its miss rate is over TSCH_OVERLOAD_THRESHOLD */
+extern volatile uint8_t tsch_slot_overloaded;
+
 
 //----------------------------------------
 
+#if TSCH_SLOT_TIMING
+/* Slot phase histograms, updated from the slot operation */
+extern struct tsch_slot_timing tsch_slot_timing;
+#endif
+
 /* Are we coordinator of the TSCH network? */
 extern int tsch_is_coordinator;
 /* Are we associated to a TSCH network? */
@@ -211,5 +307,20 @@ void tsch_set_ka_timeout(uint32_t timeout);
 void tsch_set_coordinator(int enable);
 /* Set the pan as secured or not */
 void tsch_set_pan_secured(int enable);
+/* Sum of the MAC statistics of all neighbors, past ones included.
+ * Returns 0 if the TSCH lock could not be taken */
+int tsch_mac_stats_snapshot(struct tsch_mac_stats *total);
+/* MAC statistics of a neighbor, NULL if it has none */
+const struct tsch_mac_stats *tsch_mac_stats_get(const linkaddr_t *addr);
+/* Tx of a direction that did not succeed, whatever the status */
+uint16_t tsch_mac_stats_errors(const struct tsch_mac_stats *stats, int dir);
+/* Clear the MAC statistics. Returns 0 if the TSCH lock could not be taken */
+int tsch_mac_stats_reset(void);
+#if TSCH_SLOT_TIMING
+/* Account one slot phase of the given duration, in rtimer ticks */
+void tsch_slot_timing_add(enum tsch_slot_phase phase, rtimer_clock_t duration);
+/* Clear the slot phase histograms */
+void tsch_slot_timing_reset(void);
+#endif
 
 #endif /* __TSCH_H__ */